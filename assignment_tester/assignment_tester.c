@@ -1,22 +1,34 @@
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "cache.h"
+#include "compare.h"
+#include "spawn.h"
+#include "state.h"
+#include "runner.h"
+#include "profile.h"
+#include "watch.h"
+#include "remote.h"
+#include "bench.h"
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <poll.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
 
-#define TRUE      (1)
-#define FALSE     (0)
-
-#define SUCCESS   (0)
-#define ERROR     (-1)
-
-#define MAX_PATH  (150)
 #define MAX_BUF   (150)
 
 #define FD_STDIN  (0)
@@ -25,49 +37,263 @@
 
 #define FILE_MODE (0666)
 
+// default amount of students graded concurrently (see '-j')
+#define DEFAULT_JOBS (1)
+
+// default wall-clock and CPU time budgets of a student's program (see '-t' and '-c')
+#define DEFAULT_WALL_MS (5000)
+#define DEFAULT_CPU_MS  (5000)
+
+#define USEC_PER_MSEC   (1000LL)
+#define USEC_PER_SEC    (1000000LL)
+#define NSEC_PER_USEC   (1000LL)
+
+#define BYTES_PER_MB    (1024LL * 1024LL)
+
+// default resource limits of a student's program (see '-m' and '-p')
+#define DEFAULT_MEMORY_MB (1024)
+#define DEFAULT_NPROC     (256)
+
+// a program may print up to this many times the length of the correct output (see '-o')
+// but never less than MIN_OUTPUT_LIMIT bytes
+#define DEFAULT_OUTPUT_FACTOR (4)
+#define MIN_OUTPUT_LIMIT      (4096)
+
+// results.csv is written here first, and then renamed over the old one
+#define RESULTS_PATH      "./results.csv"
+#define RESULTS_TEMP_PATH "./results.csv.tmp"
+
+// a student is graded once their directory didn't change for this long (see '--debounce')
+#define DEFAULT_DEBOUNCE_MS (2000)
+// how often watch mode checks whether it should stop
+#define WATCH_POLL_MS       (500)
+
+// workers send a heartbeat this often, and the coordinator drops a worker it didn't hear from
+// for HEARTBEAT_TIMEOUT_MS (its student goes back to the queue)
+#define HEARTBEAT_MS         (1000)
+#define HEARTBEAT_TIMEOUT_MS (10000)
+// a frame that started arriving must be complete within this long
+#define FRAME_TIMEOUT_MS     (5000)
+// a student is given up on once this many workers were lost while grading them
+#define MAX_JOB_ATTEMPTS     (3)
+// a worker keeps trying to reach the coordinator for this long
+#define CONNECT_RETRY_MS     (100)
+#define CONNECT_TIMEOUT_MS   (10000)
+
+// the benchmark runs are preceded by this many unmeasured ones (see '--bench')
+#define BENCH_WARMUP_RUNS    (1)
+#define BENCH_FILE_PATH      "./benchmark.csv"
+
+// results.csv line: name, grade, reason and the usage columns
+#define MAX_CSV_LINE    (MAX_PATH + 256)
+
+// a config line holds an input path, an output path and a weight
+#define MAX_LINE        (MAX_PATH * 2 + 32)
+#define MAX_CASES       (128)
+
+// returned by getNextLine if there's nothing left to read
+#define END_OF_FILE     (-2)
+
+// the reasons double as the grades
 enum {
+	// the test cases got different verdicts - the grade is their weighted average
+	PARTIAL           = -2,
 	NO_C_FILE         = 0,
 	COMPILATION_ERROR = 10,
+	// the program printed more than the output limit
+	OUTPUT_LIMIT      = 15,
 	TIMEOUT           = 20,
 	WRONG             = 50,
 	SIMILAR           = 75,
 	EXCELLENT         = 100
 };
 
-struct Data {
-	// path for results.csv
-	char resultsFilePath[MAX_PATH];
-	// compare file path
-	char compareFilePath[MAX_PATH];
+struct TestCase {
 	// input file for the students' programs
 	char inputFilePath[MAX_PATH];
 	// output file for comparison
 	char outputComparisonPath[MAX_PATH];
+	// the case's share of the grade
+	int weight;
+	// the program is killed once it prints more than this (in bytes)
+	long long outputLimit;
+	// the correct output - loaded once and compared against every student's output
+	struct CmpReference reference;
+	// TRUE if the program's speed is measured on this case (see '--bench')
+	int bench;
+};
+
+struct Data {
+	// path for results.csv
+	char resultsFilePath[MAX_PATH];
+	// every student's program is run on all of the test cases
+	struct TestCase cases[MAX_CASES];
+	int caseCount;
+	int totalWeight;
+	// maximum amount of test cases a student's program runs on concurrently (0 for all)
+	int parallelCases;
 	// path to the errorfile
 	char errorFilePath[MAX_PATH];
 	// main directory path
 	char mainDirPath[MAX_PATH];
+	// errors.txt is shared by all the workers - only write to it while holding errorLock
+	int fd_error;
+	pthread_mutex_t errorLock;
+	// maximum amount of students graded concurrently
+	int jobs;
+	// a student's program is killed once it runs longer than these (in milliseconds)
+	long long wallLimitMs;
+	long long cpuLimitMs;
+	// RLIMIT_AS and RLIMIT_NPROC of a student's program
+	// (RLIMIT_NPROC counts all of the user's processes, and isn't enforced for root)
+	long long memoryLimitBytes;
+	long long processLimit;
+	// the output limit of a test case, relative to the length of its correct output
+	long long outputFactor;
+	// compiled binaries and compile errors from previous runs (see '-C')
+	struct CompileCache cache;
+	// empty if the cache is disabled
+	char cacheDirPath[MAX_PATH];
+	long long cacheMaxBytes;
+	// the results of the previous run (see '-s')
+	struct GradingState state;
+	// empty if there's no state file
+	char statePath[MAX_PATH];
+	// hash of everything but the student's files that a result depends on
+	unsigned char gradingDigest[SHA256_SIZE];
+	// TRUE to start the students' programs from pre-forked runners (see '-z')
+	int useRunners;
+	struct RunnerPool runners;
+	// the amount of slowest students listed per phase in the profile (0 for no profile)
+	int profileSlowest;
+	// a JSON line per student with the phases' times (empty for no log)
+	char profileLogPath[MAX_PATH];
+	// TRUE to keep grading students as their directories change (see '--watch')
+	int watch;
+	int debounceMs;
+	// coordinator: hand the students out to the workers that connect here (see '--serve')
+	char serveAddress[MAX_PATH];
+	// worker: grade the students a coordinator hands out (see '--connect')
+	char connectAddress[MAX_PATH];
+	// the amount of workers the coordinator starts itself (see '--local-workers')
+	int localWorkers;
+	// our arguments (the local workers get them too)
+	int argc;
+	char **argv;
+	// the amount of measured runs of a correct program on a benchmarked case (0 for none)
+	int benchRuns;
+	// the CPU the benchmark runs are pinned to (ERROR to let them run anywhere)
+	int benchCpu;
+	// the share of a benchmarked case's grade a program keeps, by its median wall time
+	struct SpeedTier tiers[MAX_TIERS];
+	int tierCount;
+	// benchmark.csv is shared by all the workers - and only one of them measures at a time,
+	// so the runs don't compete for the CPU with each other
+	int fd_bench;
+	pthread_mutex_t benchLock;
+};
+
+// resources used by a child process (from wait4)
+struct Usage {
+	long long wallUsec;
+	long long userUsec;
+	long long sysUsec;
+	long maxRssKb;
+	long voluntarySwitches;
+	long involuntarySwitches;
+	long minorFaults;
+	long majorFaults;
+};
+
+// what ends up in a student's line in results.csv
+struct Result {
+	int grade;
+	int reason;
+	struct Usage compileUsage;
+	struct Usage runUsage;
+	// empty if the result shouldn't be saved in the state file
+	char fingerprint[SHA256_HEX_SIZE];
+	// the line itself (without the newline)
+	char row[MAX_CSV_LINE];
+	// TRUE if the line was taken from the state file (and the student wasn't graded)
+	int reused;
+	struct PhaseTimes times;
+};
+
+// one execution of the student's program on one test case
+struct Run {
+	struct TestCase *testCase;
+	pid_t pid;
+	// readable once the program exits (ERROR if the kernel doesn't support pidfds)
+	int pidfd;
+	// read end of the program's stdout
+	int fd_output;
+	// compares the program's output to the correct output while it's running
+	struct CmpStream stream;
+	long long startTime;
+	int exited;
+	int eof;
+	// the amount of bytes the program printed so far
+	long long outputBytes;
+	// TRUE once the program printed more than the output limit (and was killed)
+	int overflowed;
+	// set once a runner reports that it reaped the program
+	int reaped;
+	int status;
+	struct rusage rusage;
+	// TRUE once the run was reaped and graded
+	int finished;
+	// the case's grade (OUTPUT_LIMIT, TIMEOUT, WRONG, SIMILAR or EXCELLENT)
+	int grade;
+	// the share of the grade the program keeps for its speed (100 unless the case is benchmarked)
+	int speedPercent;
+	struct Usage usage;
 };
 
 struct StudentData {
 	// current (student's) directory
 	char dirPath[MAX_PATH];
-	// path to the student's binary
+	// the student's binary lives in memory (memfd) - the student's directory is only read
+	// gcc writes it through its /proc/self/fd path, and it's started with fexecve
+	int fd_bin;
 	char binFilePath[MAX_PATH];
 	// path to the student's code file
 	char codeFilePath[MAX_PATH];
-	// path to the students' output file
-	char outputFilePath[MAX_PATH];
+	// the runs of the program, one per test case
+	struct Run *runs;
+	// the runner that starts the runs (NULL if we start them ourselves)
+	struct Runner *runner;
+	// the weighted grade of the runs
+	int grade;
+	// private (memfd) log for gcc's and the program's stderr
+	// it's appended to errors.txt once the student is graded
+	int fd_error;
+	// resources used by gcc and by the student's program (summed over all of the runs)
+	struct Usage compileUsage;
+	struct Usage runUsage;
+	// how long grading the student took, per phase
+	struct PhaseTimes times;
+};
+
+// the students' directories, in the order readdir returned them
+struct StudentList {
+	char **names;
+	struct Result *results;
+	int size;
+	int capacity;
+	// index of the next student a worker should grade
+	int next;
+	pthread_mutex_t lock;
+	struct Data *data;
 };
 
 void printError(const char *funcName);
 void printCustomError(const char *msg);
 
-const char *getReason(int grade);
-const char *getGradeStr(int grade);
-void writeToCSV(int fd, const char *name, int grade);
+const char *getReason(int reason);
+void formatResult(const char *name, struct Result *result);
 char getNextChar(int fd);
-int getNextLine(int fd, char *buf);
+int getNextLine(int fd, char *buf, int size);
 int skipEntry(struct dirent *dirEntry);
 void buildPath(char *buf, const char *dirPath, const char *entryName);
 
@@ -75,31 +301,68 @@ int isCodeFile(const char *fileName);
 int getFileSize(int fd);
 int isFileEmpty(int fd);
 
-int initStudentTempFiles(struct StudentData *sData);
+int initStudentTempFiles(struct Data *data, struct StudentData *sData, const char *name);
+int destroyStudentTempFiles(struct Data *data, struct StudentData *sData);
 int initData(struct Data *data, int fd_config);
+int hashGrading(struct Data *data);
+int isStudentFile(const struct dirent *entry);
+int studentFingerprint(struct Data *data, const char *dirPath, char fingerprint[SHA256_HEX_SIZE]);
 int destroyData(struct Data *data);
+int parseArgs(struct Data *data, int argc, char *argv[]);
+
+long long getTimeUsec(void);
+long long timevalToUsec(const struct timeval *tv);
+void fillUsage(struct Usage *usage, const struct rusage *rusage, long long wallUsec);
+void initRunAttr(struct Data *data, struct SpawnAttr *attr);
+int startRun(struct Data *data, struct StudentData *sData, struct Run *run);
+int waitRunner(struct StudentData *sData, int type, int id, struct RunnerMessage *msg);
+int reapRun(struct StudentData *sData, struct Run *run, int *status, struct rusage *usage);
+void killRun(struct StudentData *sData, struct Run *run);
+int finishRun(struct Data *data, struct StudentData *sData, struct Run *run, int expired);
+int superviseRuns(struct Data *data, struct StudentData *sData, int count);
+int benchmarkRun(struct Data *data, struct StudentData *sData, struct Run *run, int caseIndex);
 
 int compileCode(struct Data *data, struct StudentData *sData);
 int runCode(struct Data *data, struct StudentData *sData);
 int compareOutputs(struct Data *data, struct StudentData *sData);
 int gradeStudent(struct Data *data, struct StudentData *sData);
+int writeProfile(struct Data *data, struct StudentList *list, long long scanUsec);
+int writeResults(struct Data *data, struct StudentList *list);
 int startGrading(struct Data *data);
+int watchStudents(struct Data *data);
+int serveStudents(struct Data *data);
+int workStudents(struct Data *data);
+
+// extra flags passed to gcc (they're also part of the compile cache's key)
+static char *const gccFlags[] = { NULL };
 
 int main(int argc, char *argv[]) {
-	// return if there aren't enough arguments (i.e. missing config file path)
-	if (argc < 2) { return ERROR; }
+	struct Data data;
+	// return if the arguments are invalid (e.g. missing config file path)
+	if (parseArgs(&data, argc, argv) == ERROR) { return ERROR; }
 
-	const char *configFilePath = argv[1];
+	const char *configFilePath = argv[optind];
 	int fd_config = open(configFilePath, O_RDONLY);
 	if (fd_config == ERROR) { return ERROR; }
 
 	int status = SUCCESS;
-	struct Data data;
 	// read config to initialize data
-	// call 'startGrading' if the data initializing was successful
-	if (initData(&data, fd_config) == ERROR ||
-		startGrading(&data) == ERROR) { 
-		status = ERROR; 
+	// call 'startGrading' (or the mode's function) if the data initializing was successful
+	if (initData(&data, fd_config) == ERROR) {
+		status = ERROR;
+	} else {
+		int graded;
+		if (data.connectAddress[0] != '\0') {
+			graded = workStudents(&data);
+		} else if (data.serveAddress[0] != '\0') {
+			graded = serveStudents(&data);
+		} else if (data.watch) {
+			graded = watchStudents(&data);
+		} else {
+			graded = startGrading(&data);
+		}
+		if (graded == ERROR) { status = ERROR; }
+		if (destroyData(&data) == ERROR) { status = ERROR; }
 	}
 
 	// clean resources
@@ -108,6 +371,159 @@ int main(int argc, char *argv[]) {
 	return status;
 }
 
+// usage: a.out [-j jobs] [-k cases] [-t wall ms] [-c cpu ms] [-m memory MB] [-p processes]
+//              [-o output factor] [-C cache dir] [-S cache MB] [-s state file] [-z]
+//              [-P slowest] [-L profile log] [--watch] [--debounce ms]
+//              [--serve address] [--local-workers count] [--connect address]
+//              [--bench runs] [--bench-cpu cpu] [--bench-tiers ms:percent,...] <config file>
+// '-j 0' grades as many students concurrently as there are online CPUs
+// a worker ('--connect') ignores '--serve', '--local-workers', '-s', '-P' and '-L'
+// (so the local workers can simply get the coordinator's arguments)
+static const struct option longOptions[] = {
+	{ "watch",         no_argument,       NULL, 'w' },
+	{ "debounce",      required_argument, NULL, 'd' },
+	{ "serve",         required_argument, NULL, 'e' },
+	{ "connect",       required_argument, NULL, 'n' },
+	{ "local-workers", required_argument, NULL, 'l' },
+	{ "bench",         required_argument, NULL, 'b' },
+	{ "bench-cpu",     required_argument, NULL, 'u' },
+	{ "bench-tiers",   required_argument, NULL, 'T' },
+	{ NULL,            0,                 NULL, 0   }
+};
+
+int parseArgs(struct Data *data, int argc, char *argv[]) {
+	data->jobs = DEFAULT_JOBS;
+	data->parallelCases = 0;
+	data->wallLimitMs = DEFAULT_WALL_MS;
+	data->cpuLimitMs = DEFAULT_CPU_MS;
+	data->memoryLimitBytes = DEFAULT_MEMORY_MB * BYTES_PER_MB;
+	data->processLimit = DEFAULT_NPROC;
+	data->outputFactor = DEFAULT_OUTPUT_FACTOR;
+	data->cacheDirPath[0] = '\0';
+	data->cacheMaxBytes = DEFAULT_CACHE_MB * BYTES_PER_MB;
+	data->statePath[0] = '\0';
+	data->useRunners = FALSE;
+	data->profileSlowest = 0;
+	data->profileLogPath[0] = '\0';
+	data->watch = FALSE;
+	data->debounceMs = DEFAULT_DEBOUNCE_MS;
+	data->serveAddress[0] = '\0';
+	data->connectAddress[0] = '\0';
+	data->localWorkers = 0;
+	data->argc = argc;
+	data->argv = argv;
+	data->benchRuns = 0;
+	// an isolated CPU is the quietest place to measure
+	data->benchCpu = isolatedCpu();
+	data->tierCount = 0;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "j:k:t:c:m:p:o:C:S:s:zP:L:", longOptions, NULL)) != ERROR) {
+		switch (opt) {
+		case 'j':
+			data->jobs = atoi(optarg);
+			if (data->jobs <= 0) {
+				data->jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			}
+			if (data->jobs <= 0) { data->jobs = DEFAULT_JOBS; }
+			break;
+		case 'k':
+			data->parallelCases = atoi(optarg);
+			if (data->parallelCases < 0) { return ERROR; }
+			break;
+		case 't':
+			data->wallLimitMs = atoll(optarg);
+			if (data->wallLimitMs <= 0) { return ERROR; }
+			break;
+		case 'c':
+			data->cpuLimitMs = atoll(optarg);
+			if (data->cpuLimitMs <= 0) { return ERROR; }
+			break;
+		case 'm':
+			data->memoryLimitBytes = atoll(optarg) * BYTES_PER_MB;
+			if (data->memoryLimitBytes <= 0) { return ERROR; }
+			break;
+		case 'p':
+			data->processLimit = atoll(optarg);
+			if (data->processLimit <= 0) { return ERROR; }
+			break;
+		case 'o':
+			data->outputFactor = atoll(optarg);
+			if (data->outputFactor <= 0) { return ERROR; }
+			break;
+		case 'C':
+			if (strlen(optarg) >= MAX_PATH) { return ERROR; }
+			strcpy(data->cacheDirPath, optarg);
+			break;
+		case 'S':
+			data->cacheMaxBytes = atoll(optarg) * BYTES_PER_MB;
+			if (data->cacheMaxBytes <= 0) { return ERROR; }
+			break;
+		case 's':
+			if (strlen(optarg) >= MAX_PATH) { return ERROR; }
+			strcpy(data->statePath, optarg);
+			break;
+		case 'z':
+			data->useRunners = TRUE;
+			break;
+		case 'P':
+			data->profileSlowest = atoi(optarg);
+			if (data->profileSlowest <= 0) { return ERROR; }
+			break;
+		case 'L':
+			if (strlen(optarg) >= MAX_PATH) { return ERROR; }
+			strcpy(data->profileLogPath, optarg);
+			break;
+		case 'w':
+			data->watch = TRUE;
+			break;
+		case 'd':
+			data->debounceMs = atoi(optarg);
+			if (data->debounceMs < 0) { return ERROR; }
+			break;
+		case 'e':
+			if (strlen(optarg) >= MAX_PATH) { return ERROR; }
+			strcpy(data->serveAddress, optarg);
+			break;
+		case 'n':
+			if (strlen(optarg) >= MAX_PATH) { return ERROR; }
+			strcpy(data->connectAddress, optarg);
+			break;
+		case 'l':
+			data->localWorkers = atoi(optarg);
+			if (data->localWorkers < 0) { return ERROR; }
+			break;
+		case 'b':
+			data->benchRuns = atoi(optarg);
+			if (data->benchRuns <= 0) { return ERROR; }
+			break;
+		case 'u':
+			data->benchCpu = atoi(optarg);
+			if (data->benchCpu < 0 || data->benchCpu >= CPU_SETSIZE) { return ERROR; }
+			break;
+		case 'T':
+			if (parseTiers(optarg, data->tiers, &data->tierCount) == ERROR) { return ERROR; }
+			break;
+		default:
+			return ERROR;
+		}
+	}
+	if (data->connectAddress[0] != '\0') {
+		// the coordinator keeps the state and the profile
+		data->serveAddress[0] = '\0';
+		data->localWorkers = 0;
+		data->statePath[0] = '\0';
+		data->profileSlowest = 0;
+		data->profileLogPath[0] = '\0';
+	}
+	// the tiers grade the benchmark
+	if (data->tierCount > 0 && data->benchRuns == 0) { return ERROR; }
+	// local workers need a coordinator, and watching isn't distributed
+	if (data->localWorkers > 0 && data->serveAddress[0] == '\0') { return ERROR; }
+	if (data->watch && (data->serveAddress[0] != '\0' || data->connectAddress[0] != '\0')) { return ERROR; }
+	// the config file path is the only positional argument
+	return optind < argc ? SUCCESS : ERROR;
+}
+
 // this function simply writes 'msg' to stderr and appends a newline
 void printCustomError(const char *msg) {
 	char buf[MAX_BUF] = { 0 };
@@ -137,24 +553,28 @@ char getNextChar(int fd) {
 }
 
 // read a line into 'buf' (i.e. until '\n' or EOF)
-// return the number of characters read
-int getNextLine(int fd, char *buf) {
+// return the number of characters read (or END_OF_FILE if there was nothing to read)
+int getNextLine(int fd, char *buf, int size) {
 	int i;
-	for (i = 0; i < MAX_PATH; i++) {
+	for (i = 0; i < size - 1; i++) {
 		// fetch the next character everytime
 		char ch = getNextChar(fd);
 		if (ch == ERROR) {
 			return ERROR;
 		}
-		// stop at '\0' or '\n' and null-terminate the buffer
+		// stop at '\0' or '\n'
 		if (ch == 0 || ch == '\n') {
-			buf[i] = '\0';
+			if (ch == 0 && i == 0) {
+				buf[0] = '\0';
+				return END_OF_FILE;
+			}
 			break;
 		}
 		// write the character to buf
 		buf[i] = ch;
 	}
-	// return the length of buf
+	// null-terminate the buffer and return its length
+	buf[i] = '\0';
 	return i;
 }
 
@@ -227,326 +647,1868 @@ int isFileEmpty(int fd) {
 	return size == 0;
 }
 
-// create a child process to call gcc on the student's code
-int compileCode(struct Data *data, struct StudentData *sData) {	
-	pid_t pid = fork();
-	if (pid == ERROR) {
-		printError("fork");
-		return ERROR;
-	} 
-	if (pid == 0) {
-		// child
-		// redirect output to log file
-		int fd = open(data->errorFilePath, O_WRONLY);
-		// make sure we append to fd_error 
-		// O_APPEND may not work on certain filesystems, so we manually seek the end of the file
-		if (fd == ERROR || lseek(fd, 0, SEEK_END) == ERROR) { exit(ERROR); }
-		if (dup2(fd, FD_ERROR) == ERROR ||
-		    close(fd) == ERROR) {
-			exit(ERROR);
-		}
-
-		// call gcc to compile the file in 'filePath'
-		char *argv[5];
-		argv[0] = "gcc";
-		argv[1] = sData->codeFilePath;
-		argv[2] = "-o";
-		argv[3] = sData->binFilePath;
-		argv[4] = NULL;
-		// we can assume gcc is in the PATH env
-		execvp("gcc", argv);
-		// exit incase execvp returned an error
-		exit(ERROR);
+// current CLOCK_MONOTONIC time in microseconds
+long long getTimeUsec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / NSEC_PER_USEC;
+}
+
+long long timevalToUsec(const struct timeval *tv) {
+	return tv->tv_sec * USEC_PER_SEC + tv->tv_usec;
+}
+
+void fillUsage(struct Usage *usage, const struct rusage *rusage, long long wallUsec) {
+	usage->wallUsec = wallUsec;
+	usage->userUsec = timevalToUsec(&rusage->ru_utime);
+	usage->sysUsec = timevalToUsec(&rusage->ru_stime);
+	usage->maxRssKb = rusage->ru_maxrss;
+	usage->voluntarySwitches = rusage->ru_nvcsw;
+	usage->involuntarySwitches = rusage->ru_nivcsw;
+	usage->minorFaults = rusage->ru_minflt;
+	usage->majorFaults = rusage->ru_majflt;
+}
+
+// check on a child without reaping it
+int hasExited(pid_t pid) {
+	siginfo_t info;
+	info.si_pid = 0;
+	if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == ERROR) { return TRUE; }
+	return info.si_pid != 0;
+}
+
+// wait for the runner's reply of type 'type' about run 'id'
+// the runs that exit in the meantime are marked as reaped
+int waitRunner(struct StudentData *sData, int type, int id, struct RunnerMessage *msg) {
+	while (TRUE) {
+		if (runnerReceive(sData->runner, msg) == ERROR) {
+			printError("runnerReceive");
+			return ERROR;
+		}
+		if (msg->type == RUNNER_EXITED) {
+			struct Run *run = &sData->runs[msg->id];
+			run->exited = TRUE;
+			run->reaped = TRUE;
+			run->status = msg->status;
+			run->rusage = msg->usage;
+		}
+		if ((type == ERROR || msg->type == type) && (id == ERROR || msg->id == id)) {
+			return SUCCESS;
+		}
+	}
+}
+
+// kill the run's process group and reap the program
+int reapRun(struct StudentData *sData, struct Run *run, int *status, struct rusage *usage) {
+	if (sData->runner != NULL) {
+		// the runner reaps its own programs - ask it to kill this one and wait for its report
+		struct RunnerMessage msg;
+		if (!run->reaped && (runnerKill(sData->runner, run - sData->runs) == ERROR ||
+		                     waitRunner(sData, RUNNER_EXITED, run - sData->runs, &msg) == ERROR)) {
+			return ERROR;
+		}
+		*status = run->status;
+		*usage = run->rusage;
+		return SUCCESS;
+	}
+
+	// kill the whole group - the student's program may have forked
+	// (ESRCH simply means everyone is already gone)
+	kill(-run->pid, SIGKILL);
+	int ret = wait4(run->pid, status, 0, usage);
+	if (run->pidfd != ERROR) { close(run->pidfd); }
+	if (ret == ERROR) {
+		printError("wait4");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+// kill the run's process group (it's still reaped as usual)
+void killRun(struct StudentData *sData, struct Run *run) {
+	if (sData->runner != NULL) {
+		runnerKill(sData->runner, run - sData->runs);
+	} else {
+		kill(-run->pid, SIGKILL);
 	}
+}
 
+// reap a run and grade it
+// 'expired' is TRUE if the run is killed because it passed the wall-clock deadline
+int finishRun(struct Data *data, struct StudentData *sData, struct Run *run, int expired) {
 	int status;
-	// wait for the child process to finish compiling
-	if (waitpid(pid, &status, 0) == ERROR) {
-		printError("waitpid");
+	struct rusage usage;
+	int ret = reapRun(sData, run, &status, &usage);
+	close(run->fd_output);
+	run->finished = TRUE;
+	if (ret == ERROR) { return ERROR; }
+	fillUsage(&run->usage, &usage, getTimeUsec() - run->startTime);
+
+	// the CPU rlimit kills with SIGXCPU/SIGKILL, but only has a granularity of a second
+	long long cpuUsec = run->usage.userUsec + run->usage.sysUsec;
+	int cpuExceeded = cpuUsec > data->cpuLimitMs * USEC_PER_MSEC ||
+		(WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU);
+	if (run->overflowed) {
+		run->grade = OUTPUT_LIMIT;
+		return SUCCESS;
+	}
+	if (expired || cpuExceeded) {
+		run->grade = TIMEOUT;
+		return SUCCESS;
+	}
+	// the output was already compared while the program ran - just translate the verdict
+	switch (cmpStreamFinish(&run->stream)) {
+	case FILES_IDENTICAL: run->grade = EXCELLENT; break;
+	case FILES_SIMILAR:   run->grade = SIMILAR;   break;
+	default:              run->grade = WRONG;     break;
+	}
+	return SUCCESS;
+}
+
+// wait until at least one of the unfinished runs exits (or passes its deadline)
+// meanwhile, everything the programs print is fed to their comparators
+// once a run's deadline passes, its whole process group is killed
+// returns the amount of runs that finished
+int superviseRuns(struct Data *data, struct StudentData *sData, int count) {
+	struct Run *runs = sData->runs;
+	struct pollfd pfds[MAX_CASES * 2 + 1];
+	// the run each pollfd belongs to (NULL for the runner)
+	struct Run *owners[MAX_CASES * 2 + 1];
+	int polled = 0;
+	// the runner tells us when its programs exit
+	if (sData->runner != NULL) {
+		pfds[polled].fd = sData->runner->fd;
+		pfds[polled].events = POLLIN;
+		owners[polled++] = NULL;
+	}
+	long long now = getTimeUsec();
+	long long deadlineUsec = ERROR;
+	int i;
+	for (i = 0; i < count; i++) {
+		struct Run *run = &runs[i];
+		if (run->finished) { continue; }
+		long long runDeadline = run->startTime + data->wallLimitMs * USEC_PER_MSEC;
+		if (deadlineUsec == ERROR || runDeadline < deadlineUsec) { deadlineUsec = runDeadline; }
+		if (!run->eof) {
+			pfds[polled].fd = run->fd_output;
+			pfds[polled].events = POLLIN;
+			owners[polled++] = run;
+		}
+		if (!run->exited && run->pidfd != ERROR) {
+			pfds[polled].fd = run->pidfd;
+			pfds[polled].events = POLLIN;
+			owners[polled++] = run;
+		} else if (!run->exited && sData->runner == NULL) {
+			// no pidfd support (old kernel) - check on the child every millisecond
+			deadlineUsec = now < deadlineUsec - USEC_PER_MSEC ? now + USEC_PER_MSEC : deadlineUsec;
+		}
+	}
+	if (deadlineUsec == ERROR) { return 0; }
+
+	// round up, so we never wake up right before the deadline
+	int timeoutMs = now < deadlineUsec ? (deadlineUsec - now + USEC_PER_MSEC - 1) / USEC_PER_MSEC : 0;
+	if (poll(pfds, polled, timeoutMs) == ERROR && errno != EINTR) {
+		printError("poll");
 		return ERROR;
 	}
 
-	int ret = 0;
-	if (WIFEXITED(status)) {
-		ret = WEXITSTATUS(status);
+	char buf[BUFSIZ * 8];
+	for (i = 0; i < polled; i++) {
+		struct Run *run = owners[i];
+		if (pfds[i].revents == 0) { continue; }
+		if (run == NULL) {
+			struct RunnerMessage msg;
+			if (waitRunner(sData, ERROR, ERROR, &msg) == ERROR) { return ERROR; }
+		} else if (pfds[i].fd == run->fd_output) {
+			ssize_t bytes = read(run->fd_output, buf, sizeof(buf));
+			if (bytes > 0) {
+				run->outputBytes += bytes;
+				// a program that prints in an endless loop costs no more than the limit
+				// (once it's killed, whatever is left in the pipe is dropped)
+				if (run->overflowed) {
+					continue;
+				} else if (run->outputBytes > run->testCase->outputLimit) {
+					run->overflowed = TRUE;
+					killRun(sData, run);
+				} else {
+					cmpStreamFeed(&run->stream, buf, bytes);
+				}
+			} else if (bytes == 0 || errno != EINTR) {
+				run->eof = TRUE;
+			}
+		} else {
+			run->exited = TRUE;
+			// kill whatever the program left behind, they may keep the pipe open
+			kill(-run->pid, SIGKILL);
+		}
 	}
 
-	// gcc returns 0 on success
-	return ret == 0 ? EXCELLENT : COMPILATION_ERROR;
+	int finished = 0;
+	now = getTimeUsec();
+	for (i = 0; i < count; i++) {
+		struct Run *run = &runs[i];
+		if (run->finished) { continue; }
+		if (!run->exited && sData->runner == NULL && run->pidfd == ERROR && hasExited(run->pid)) {
+			run->exited = TRUE;
+			kill(-run->pid, SIGKILL);
+		}
+		int expired = now >= run->startTime + data->wallLimitMs * USEC_PER_MSEC;
+		if (expired || (run->exited && run->eof)) {
+			if (finishRun(data, sData, run, expired && !(run->exited && run->eof)) == ERROR) { return ERROR; }
+			finished++;
+		}
+	}
+	return finished;
 }
 
-// run the student's code
-// feed its input according the config file using redirection
-// make sure it doesn't print to the terminal by redirecting output to errors.txt
-int runCode(struct Data *data, struct StudentData *sData) {
-	pid_t pid = fork();
-	if (pid == ERROR) {
-		printError("fork");
-		return ERROR;
-	} 
-	if (pid == 0) {
-		// child
-		// redirect standard descriptors
-		int fd_input = open(data->inputFilePath, O_RDONLY);
-		int fd_output = open(sData->outputFilePath, O_WRONLY | O_CREAT | O_TRUNC, FILE_MODE);
-		// make sure we append to fd_error 
-		// O_APPEND may not work on certain filesystems, so we manually seek the end of the file
-		int fd_error = open(data->errorFilePath, O_WRONLY);
-		if (fd_error == ERROR || lseek(fd_error, 0, SEEK_END) == ERROR) { exit(ERROR); }
-		if (fd_input == ERROR ||
-		    fd_output == ERROR ||
-		    dup2(fd_input, FD_STDIN) == ERROR ||
-		    dup2(fd_output, FD_STDOUT) == ERROR ||
-		    dup2(fd_error, FD_ERROR) == ERROR ||
-		    close(fd_input) == ERROR ||
-		    close(fd_output) == ERROR ||
-		    close(fd_error) == ERROR) {
-			exit(ERROR);
-		}
-
-		// run the student's program (a.out)
-		char *argv[2];
-		argv[0] = sData->binFilePath;
-		argv[1] = NULL;
-		execvp(sData->binFilePath, argv);
-		// exit incase execvp returned an error
-		exit(ERROR);
-	}
-
-	// start a timer and wait for the child process to end
-	time_t startTime = time(NULL);
-	if (waitpid(pid, NULL, 0) == ERROR) {
-		printError("waitpid");
-		return ERROR;
-	}
-	time_t endTime = time(NULL);
-	// if the child took more than MAX_SECONDS to run we return TIMEOUT
-	const int MAX_SECONDS = 5;
-	return endTime - startTime > MAX_SECONDS ? TIMEOUT : EXCELLENT;
-}
-
-// this function uses 'comp.out' to compare the student's output to the correct output
-int compareOutputs(struct Data *data, struct StudentData *sData) {
-	pid_t pid = fork();
+// create a child process to call gcc on the student's code
+int compileCode(struct Data *data, struct StudentData *sData) {	
+	// a cache hit skips gcc entirely
+	char key[SHA256_HEX_SIZE];
+	int cached = data->cache.enabled && cacheKey(&data->cache, sData->codeFilePath, isStudentFile, key) == SUCCESS;
+	if (cached) {
+		switch (cacheLookup(&data->cache, key, sData->fd_bin, sData->fd_error)) {
+		case CACHE_BINARY:        return EXCELLENT;
+		case CACHE_COMPILE_ERROR: return COMPILATION_ERROR;
+		default:                  break;
+		}
+	}
+	// remember where gcc's messages start, in case we have to cache them
+	off_t logStart = lseek(sData->fd_error, 0, SEEK_CUR);
+
+	// call gcc to compile the file in 'filePath'
+	char *argv[5 + sizeof(gccFlags) / sizeof(gccFlags[0])];
+	argv[0] = "gcc";
+	argv[1] = sData->codeFilePath;
+	argv[2] = "-o";
+	argv[3] = sData->binFilePath;
+	memcpy(&argv[4], gccFlags, sizeof(gccFlags));
+
+	// redirect output to the student's private log
+	// we can assume gcc is in the PATH env
+	struct SpawnAttr attr;
+	spawnInit(&attr);
+	attr.searchPath = TRUE;
+	spawnRedirect(&attr, sData->fd_error, FD_ERROR);
+	// keep the binary's memfd open in gcc (and the linker), so it can write to it
+	spawnRedirect(&attr, sData->fd_bin, sData->fd_bin);
+	long long startTime = getTimeUsec();
+	pid_t pid = spawnProcess(&attr, "gcc", argv);
 	if (pid == ERROR) {
-		printError("fork");
-		return ERROR;
-	}
-	if (pid == 0) {
-		// child
-		// redirect output to dev/null
-		// because we don't want to print to the terminal
-		int fd_out = open("/dev/null", O_WRONLY);
-		if (fd_out == ERROR || 
-		    dup2(fd_out, FD_STDOUT) == ERROR || 
-		    dup2(fd_out, FD_ERROR) == ERROR ||
-		    close(fd_out) == ERROR) {
-			exit(ERROR);
-		}
-		// run comp.out
-		char *argv[4];
-		argv[0] = data->compareFilePath;
-		argv[1] = data->outputComparisonPath;
-		argv[2] = sData->outputFilePath;
-		argv[3] = NULL;
-		execvp(data->compareFilePath, argv);
-		// exit incase execvp returned an error
-		exit(ERROR);
+		printError("spawnProcess");
+		return ERROR;
 	}
 
 	int status;
-	if (waitpid(pid, &status, 0) == ERROR) {
-		perror("waitpid");
+	struct rusage usage;
+	// wait for the child process to finish compiling
+	if (wait4(pid, &status, 0, &usage) == ERROR) {
+		printError("wait4");
 		return ERROR;
 	}
+	fillUsage(&sData->compileUsage, &usage, getTimeUsec() - startTime);
 
-	// get comp.out's return value
 	int ret = 0;
 	if (WIFEXITED(status)) {
 		ret = WEXITSTATUS(status);
 	}
 
-	switch (ret) {
-	case 1:  return EXCELLENT;
-	case 2:  return WRONG;
-	case 3:  return SIMILAR;
-	default: return ERROR;
+	// gcc returns 0 on success
+	int result = ret == 0 ? EXCELLENT : COMPILATION_ERROR;
+	// a failure to cache only costs us a compilation next time
+	if (cached && (WIFEXITED(status) || result == EXCELLENT)) {
+		cacheStore(&data->cache, key, result == EXCELLENT ? sData->fd_bin : ERROR, sData->fd_error, logStart);
 	}
+	return result;
 }
 
-// read the config file and initialize data's fields
-int initData(struct Data *data, int fd_config) {
-	// read paths from config file
-	if (getNextLine(fd_config, data->mainDirPath) == ERROR ||
-		getNextLine(fd_config, data->inputFilePath) == ERROR ||
-		getNextLine(fd_config, data->outputComparisonPath) == ERROR) {
+// the setup of every student's program (except for the redirections)
+void initRunAttr(struct Data *data, struct SpawnAttr *attr) {
+	// run in a process group of our own, so a timeout can kill everything we spawn
+	// and cap the CPU time (SIGXCPU at the soft limit, SIGKILL a second later)
+	spawnInit(attr);
+	attr->newGroup = TRUE;
+	rlim_t cpuSeconds = (data->cpuLimitMs + 999) / 1000;
+	spawnLimit(attr, RLIMIT_CPU, cpuSeconds, cpuSeconds + 1);
+	// keep memory hogs and fork bombs from slowing down the students graded next to them
+	spawnLimit(attr, RLIMIT_AS, data->memoryLimitBytes, data->memoryLimitBytes);
+	spawnLimit(attr, RLIMIT_NPROC, data->processLimit, data->processLimit);
+}
+
+// hand the run to the runner, which already has the input open
+int startRunnerRun(struct Data *data, struct StudentData *sData, struct Run *run, int fd_output) {
+	int id = run - sData->runs;
+	struct RunnerMessage msg;
+	if (runnerStart(sData->runner, id, sData->fd_bin, run->testCase - data->cases,
+	                fd_output, sData->fd_error) == ERROR) {
+		printError("runnerStart");
 		return ERROR;
 	}
-	if (access(data->mainDirPath, F_OK) == ERROR) {
-		if (errno == ENOENT) {
-			printCustomError("Not a valid directory");	
-		} else {
-			printError("access");
-		}
+	if (waitRunner(sData, RUNNER_STARTED, id, &msg) == ERROR) { return ERROR; }
+	if (msg.pid == ERROR) {
+		errno = msg.error;
+		printError("spawnProcess");
 		return ERROR;
 	}
-	// check if input file exists
-	if (access(data->inputFilePath, F_OK) == ERROR) {
-		if (errno == ENOENT) {
-			printCustomError("Input file not exist");
-		} else {
-			printError("access");
-		}
+	run->pid = msg.pid;
+	return SUCCESS;
+}
+
+// start the student's program on a test case
+// feed its input according the config file using redirection
+// its output goes through a pipe straight into the run's comparator
+// make sure it doesn't print to the terminal by redirecting errors to the student's log
+int startRun(struct Data *data, struct StudentData *sData, struct Run *run) {
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == ERROR) {
+		printError("pipe2");
 		return ERROR;
 	}
-	// check if the output file exists
-	if (access(data->outputComparisonPath, F_OK) == ERROR) {
-		if (errno == ENOENT) {
-			printCustomError("Output file not exist");
-		} else {
-			printError("access");
+	run->pidfd = ERROR;
+	run->speedPercent = 100;
+	run->exited = FALSE;
+	run->reaped = FALSE;
+	run->outputBytes = 0;
+	run->overflowed = FALSE;
+	if (sData->runner != NULL) {
+		// start a timer (the deadline counts from here)
+		run->startTime = getTimeUsec();
+		int ret = startRunnerRun(data, sData, run, fds[1]);
+		close(fds[1]);
+		if (ret == ERROR) {
+			close(fds[0]);
+			return ERROR;
 		}
-		return ERROR;
+		run->fd_output = fds[0];
+		run->eof = FALSE;
+		run->finished = FALSE;
+		cmpStreamInit(&run->stream, &run->testCase->reference);
+		return SUCCESS;
 	}
 
-	// save compare file path
-	strcpy(data->compareFilePath, "./comp.out");
-	// create errors.txt file and save its path
-	strcpy(data->errorFilePath, "./errors.txt");
-	int fd_error = open(data->errorFilePath, O_CREAT | O_TRUNC, FILE_MODE);
-	if (fd_error == ERROR) { 
+	int fd_input = open(run->testCase->inputFilePath, O_RDONLY | O_CLOEXEC);
+	if (fd_input == ERROR) {
 		printError("open");
-		return ERROR; 
+		close(fds[0]);
+		close(fds[1]);
+		return ERROR;
 	}
-	if (close(fd_error) == ERROR) { 
-		printError("close");
-		return ERROR; 
+
+	struct SpawnAttr attr;
+	initRunAttr(data, &attr);
+	// redirect standard descriptors
+	spawnRedirect(&attr, fd_input, FD_STDIN);
+	spawnRedirect(&attr, fds[1], FD_STDOUT);
+	spawnRedirect(&attr, sData->fd_error, FD_ERROR);
+
+	// run the student's program (a.out) straight from its memfd
+	attr.execFd = sData->fd_bin;
+	char *argv[2];
+	argv[0] = "a.out";
+	argv[1] = NULL;
+	// start a timer (the deadline counts from here)
+	run->startTime = getTimeUsec();
+	run->pid = spawnProcess(&attr, NULL, argv);
+	// only the child uses these (and we'd never see EOF on the pipe otherwise)
+	close(fd_input);
+	close(fds[1]);
+	if (run->pid == ERROR) {
+		printError("spawnProcess");
+		close(fds[0]);
+		return ERROR;
 	}
 
+	// a pidfd becomes readable when the process exits, so we can poll it with a timeout
+	run->pidfd = syscall(SYS_pidfd_open, run->pid, 0);
+	run->fd_output = fds[0];
+	run->eof = FALSE;
+	run->finished = FALSE;
+	cmpStreamInit(&run->stream, &run->testCase->reference);
 	return SUCCESS;
 }
 
-// helper function to get the appropriate reason for a grade
-const char *getReason(int grade) {
-	switch(grade) {
-	case NO_C_FILE:         return "NO_C_FILE";
-	case COMPILATION_ERROR: return "COMPILATION_ERROR";
-	case TIMEOUT:           return "TIMEOUT";
-	case WRONG:             return "WRONG";
-	case SIMILAR:           return "SIMILAR";
-	case EXCELLENT:         return "EXCELLENT";
-	default:                return "No reason";
+// run the program once on 'data->benchCpu' (output discarded) and time it
+// returns its exit status (instructions is ERROR if they can't be counted)
+int benchmarkOnce(struct Data *data, struct StudentData *sData, int fd_input, int fd_null, int counter,
+                  long long *wallUsec, long long *cpuUsec, long long *instructions) {
+	if (lseek(fd_input, 0, SEEK_SET) == ERROR) {
+		printError("lseek");
+		return ERROR;
 	}
-}
+	struct SpawnAttr attr;
+	initRunAttr(data, &attr);
+	spawnRedirect(&attr, fd_input, FD_STDIN);
+	spawnRedirect(&attr, fd_null, FD_STDOUT);
+	spawnRedirect(&attr, fd_null, FD_ERROR);
+	attr.execFd = sData->fd_bin;
+	attr.cpu = data->benchCpu;
+	char *argv[2];
+	argv[0] = "a.out";
+	argv[1] = NULL;
 
-// helper function to get a string format of a grade
-// instead of using a conversion function
-const char *getGradeStr(int grade) {
-	switch(grade) {
-	case NO_C_FILE:         return "0";
-	case COMPILATION_ERROR: return "10";
-	case TIMEOUT:           return "20";
-	case WRONG:             return "50";
-	case SIMILAR:           return "75";
-	case EXCELLENT:         return "100";
-	default:                return "0";
-	}	
+	long long before = counter != ERROR ? counterStop(counter) : ERROR;
+	if (counter != ERROR) { counterStart(counter); }
+	long long startTime = getTimeUsec();
+	pid_t pid = spawnProcess(&attr, NULL, argv);
+	if (pid == ERROR) {
+		printError("spawnProcess");
+		if (counter != ERROR) { counterStop(counter); }
+		return ERROR;
+	}
+	// it passed the test case within the limits already - but it may not be deterministic
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd != ERROR) {
+		// a signal may interrupt the poll - go on waiting with the time that's left
+		long long deadlineUsec = startTime + data->wallLimitMs * USEC_PER_MSEC;
+		struct pollfd pfd = { pidfd, POLLIN, 0 };
+		int ready;
+		do {
+			long long now = getTimeUsec();
+			int timeoutMs = now < deadlineUsec ? (deadlineUsec - now + USEC_PER_MSEC - 1) / USEC_PER_MSEC : 0;
+			ready = poll(&pfd, 1, timeoutMs);
+		} while (ready == ERROR && errno == EINTR);
+		// kill it unless it exited (so the wait below can't hang)
+		if (ready <= 0) { kill(-pid, SIGKILL); }
+		close(pidfd);
+	}
+	int status;
+	struct rusage usage;
+	pid_t waited;
+	do {
+		waited = wait4(pid, &status, 0, &usage);
+	} while (waited == ERROR && errno == EINTR);
+	*wallUsec = getTimeUsec() - startTime;
+	long long after = counter != ERROR ? counterStop(counter) : ERROR;
+	if (waited == ERROR) {
+		printError("wait4");
+		return ERROR;
+	}
+	*cpuUsec = timevalToUsec(&usage.ru_utime) + timevalToUsec(&usage.ru_stime);
+	*instructions = before != ERROR && after != ERROR ? after - before : ERROR;
+	return status;
 }
 
-// this function writes a line into results.csv
-void writeToCSV(int fd, const char *name, int grade) {
-	const char *gradeStr = getGradeStr(grade);
-	const char *reason = getReason(grade);
-
-	char buf[MAX_BUF] = { 0 };
-	strcat(buf, name);
-	strcat(buf, ",");
-	strcat(buf, gradeStr);
-	strcat(buf, ",");
-	strcat(buf, reason);
-	strcat(buf, "\n");
-	if(write(fd, buf, strlen(buf)) == ERROR) {}
-}
+// time a correct program on a benchmarked case, pick its speed tier
+// and append "student,case,runs,median wall ms,wall MAD ms,median CPU ms,CPU MAD ms,median instructions,percent"
+// to benchmark.csv (the instructions are empty if perf_event_open isn't permitted)
+int benchmarkRun(struct Data *data, struct StudentData *sData, struct Run *run, int caseIndex) {
+	int runs = data->benchRuns;
+	long long *values = malloc(3 * runs * sizeof(long long));
+	if (values == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	long long *wall = values, *cpu = values + runs, *instructions = values + 2 * runs;
+	int fd_input = open(run->testCase->inputFilePath, O_RDONLY | O_CLOEXEC);
+	int fd_null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (fd_input == ERROR || fd_null == ERROR) {
+		printError("open");
+		if (fd_input != ERROR) { close(fd_input); }
+		if (fd_null != ERROR) { close(fd_null); }
+		free(values);
+		return ERROR;
+	}
 
-// this function goes through the whole process of testing and grading one student
-int gradeStudent(struct Data *data, struct StudentData *sData) {	
-	// make sure the code file exists
-	char codeFileName[MAX_PATH];
-	if (findFile(codeFileName, sData->dirPath, isCodeFile) == FALSE) {
-		return NO_C_FILE;
+	// one benchmark at a time
+	pthread_mutex_lock(&data->benchLock);
+	int counter = counterOpen();
+	int counted = counter != ERROR;
+	int status = SUCCESS;
+	int measured = TRUE;
+	int i;
+	for (i = -BENCH_WARMUP_RUNS; i < runs; i++) {
+		long long wallUsec, cpuUsec, count;
+		int exitStatus = benchmarkOnce(data, sData, fd_input, fd_null, counter, &wallUsec, &cpuUsec, &count);
+		if (exitStatus == ERROR) {
+			status = ERROR;
+			break;
+		}
+		// a run that crashed or was killed can't be measured
+		if (!WIFEXITED(exitStatus)) {
+			measured = FALSE;
+			break;
+		}
+		if (i < 0) { continue; }
+		wall[i] = wallUsec;
+		cpu[i] = cpuUsec;
+		instructions[i] = count;
+		if (count == ERROR) { counted = FALSE; }
 	}
-	// save its path
-	buildPath(sData->codeFilePath, sData->dirPath, codeFileName);
+	if (counter != ERROR) { close(counter); }
 
-	// make sure the code compiles
-	int compilationStatus = compileCode(data, sData);
-	switch (compilationStatus) {
-	case ERROR:
-	case COMPILATION_ERROR:
-		return compilationStatus;
+	const char *name = strrchr(sData->dirPath, '/');
+	name = name != NULL ? name + 1 : sData->dirPath;
+	if (status == SUCCESS && measured) {
+		long long wallMedian, wallMad, cpuMedian, cpuMad, instrMedian, instrMad;
+		medianMad(wall, runs, &wallMedian, &wallMad);
+		medianMad(cpu, runs, &cpuMedian, &cpuMad);
+		medianMad(instructions, runs, &instrMedian, &instrMad);
+		if (data->tierCount > 0) { run->speedPercent = tierPercent(data->tiers, data->tierCount, wallMedian); }
+		char count[32] = "";
+		if (counted) { snprintf(count, sizeof(count), "%lld", instrMedian); }
+		dprintf(data->fd_bench, "%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%s,%d\n", name, caseIndex + 1, runs,
+		        wallMedian / (double)USEC_PER_MSEC, wallMad / (double)USEC_PER_MSEC,
+		        cpuMedian / (double)USEC_PER_MSEC, cpuMad / (double)USEC_PER_MSEC, count, run->speedPercent);
+	} else if (status == SUCCESS) {
+		// a program that can't be measured doesn't get the speed's share
+		if (data->tierCount > 0) { run->speedPercent = 0; }
+		dprintf(data->fd_bench, "%s,%d,0,,,,,,%d\n", name, caseIndex + 1, run->speedPercent);
 	}
+	pthread_mutex_unlock(&data->benchLock);
 
-	// run the program and save its output
-	int ranSuccessfully = runCode(data, sData);
-	// delete the binary
-	if (remove(sData->binFilePath) == ERROR) { return ERROR; }
+	close(fd_input);
+	close(fd_null);
+	free(values);
+	return status;
+}
 
-	switch (ranSuccessfully) {
-	case ERROR:
-	case TIMEOUT:
-		// delete the output file
-		if (remove(sData->outputFilePath) == ERROR) { return ERROR; }
-		return ranSuccessfully;
+// run the student's code on all of the test cases
+// up to 'data->parallelCases' runs at a time (or all of them at once)
+int runCode(struct Data *data, struct StudentData *sData) {
+	int limit = data->parallelCases > 0 ? data->parallelCases : data->caseCount;
+	long long startTime = getTimeUsec();
+	int started = 0, finished = 0;
+	int status = SUCCESS;
+	while (finished < started || (status == SUCCESS && started < data->caseCount)) {
+		// start new runs as others finish
+		while (status == SUCCESS && started < data->caseCount && started - finished < limit) {
+			struct Run *run = &sData->runs[started];
+			run->testCase = &data->cases[started];
+			if (startRun(data, sData, run) == ERROR) {
+				status = ERROR;
+				break;
+			}
+			started++;
+		}
+		int ret = superviseRuns(data, sData, started);
+		if (ret == ERROR) {
+			status = ERROR;
+			break;
+		}
+		finished += ret;
 	}
 
-	// compare the student's output to the correct output
-	int compareResult = compareOutputs(data, sData);
-	// delete the output file
-	if (remove(sData->outputFilePath) == ERROR) { return ERROR; }
-
-	// if we got here - no errors were found 
-	return compareResult;
-}
+	// don't leave anything running if something went wrong
+	int i;
+	for (i = 0; i < started; i++) {
+		if (!sData->runs[i].finished) { finishRun(data, sData, &sData->runs[i], TRUE); }
+	}
+	if (status == ERROR) { return ERROR; }
 
-int startGrading(struct Data *data) {
-	// open the directory that contains all of the students' directories
-	DIR *mainDir = opendir(data->mainDirPath);
-	// no need to print invalid dir path because we've already checked in init
-	if (mainDir == NULL) {
-		printError("opendir");
-		return ERROR;
+	// sum the usage of the runs (except for the wall time - they overlap)
+	struct Usage *total = &sData->runUsage;
+	total->wallUsec = getTimeUsec() - startTime;
+	for (i = 0; i < data->caseCount; i++) {
+		struct Usage *usage = &sData->runs[i].usage;
+		total->userUsec += usage->userUsec;
+		total->sysUsec += usage->sysUsec;
+		if (usage->maxRssKb > total->maxRssKb) { total->maxRssKb = usage->maxRssKb; }
+		total->voluntarySwitches += usage->voluntarySwitches;
+		total->involuntarySwitches += usage->involuntarySwitches;
+		total->minorFaults += usage->minorFaults;
+		total->majorFaults += usage->majorFaults;
 	}
 
-	// create the results.csv file (or overwrite it)
-	int fd_results = open("./results.csv", O_RDWR | O_CREAT | O_TRUNC, FILE_MODE);
-	if (fd_results == ERROR) {
-		printError("open");
-		closedir(mainDir);
-		return ERROR; 
+	// measure the speed of the correct programs
+	for (i = 0; i < data->caseCount; i++) {
+		struct Run *run = &sData->runs[i];
+		if (run->testCase->bench && (run->grade == EXCELLENT || run->grade == SIMILAR) &&
+		    benchmarkRun(data, sData, run, i) == ERROR) {
+			return ERROR;
+		}
 	}
+	return SUCCESS;
+}
 
-	// run through all the directory's entries
-	struct dirent *dirEntry;
-	while (dirEntry = readdir(mainDir)) {
-		// we only care about directories (that aren't . or ..)
-		if (skipEntry(dirEntry)) { continue; }
+// combine the verdicts of the test cases into the student's grade (sData->grade)
+// return the reason - the cases' verdict if they all agree, PARTIAL otherwise
+int compareOutputs(struct Data *data, struct StudentData *sData) {
+	int reason = sData->runs[0].grade;
+	long long weightedSum = 0;
+	int i;
+	for (i = 0; i < data->caseCount; i++) {
+		struct Run *run = &sData->runs[i];
+		weightedSum += (long long)run->grade * run->speedPercent * run->testCase->weight;
+		if (run->grade != reason) { reason = PARTIAL; }
+	}
+	// divide once (speed is a percent) and round to the nearest grade
+	long long divisor = 100LL * data->totalWeight;
+	sData->grade = (weightedSum + divisor / 2) / divisor;
+	return reason;
+}
 
-		// initialize paths
-		struct StudentData sData;
-		buildPath(sData.dirPath, data->mainDirPath, dirEntry->d_name);
-		buildPath(sData.binFilePath, sData.dirPath, "a.out");
-		buildPath(sData.outputFilePath, sData.dirPath, "student.out");
-		// get the user's grade
-		int grade = gradeStudent(data, &sData);
-		if (grade != ERROR) {
-			// finally, write the grade and reason into the csv file
-			writeToCSV(fd_results, dirEntry->d_name, grade);
+// check that a file from the config exists
+int checkConfigFile(const char *path, const char *missingMsg) {
+	if (access(path, F_OK) == ERROR) {
+		if (errno == ENOENT) {
+			printCustomError(missingMsg);
+		} else {
+			printError("access");
 		}
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+// add a test case and load its correct output
+int addTestCase(struct Data *data, const char *inputPath, const char *outputPath, int weight) {
+	if (data->caseCount == MAX_CASES) {
+		printCustomError("Too many test cases");
+		return ERROR;
+	}
+	if (weight <= 0) {
+		printCustomError("Invalid test case weight");
+		return ERROR;
+	}
+	if (checkConfigFile(inputPath, "Input file not exist") == ERROR ||
+	    checkConfigFile(outputPath, "Output file not exist") == ERROR) {
+		return ERROR;
+	}
+	struct TestCase *testCase = &data->cases[data->caseCount];
+	strcpy(testCase->inputFilePath, inputPath);
+	strcpy(testCase->outputComparisonPath, outputPath);
+	testCase->weight = weight;
+	testCase->bench = FALSE;
+	// load the correct output once for all of the students
+	if (cmpLoadReference(&testCase->reference, outputPath) == ERROR) {
+		return ERROR;
+	}
+	testCase->outputLimit = testCase->reference.rawLen * data->outputFactor;
+	if (testCase->outputLimit < MIN_OUTPUT_LIMIT) { testCase->outputLimit = MIN_OUTPUT_LIMIT; }
+	data->caseCount++;
+	data->totalWeight += weight;
+	return SUCCESS;
+}
+
+// read the test cases from the config file
+// the original format is an input path on the second line and an output path on the third
+// otherwise, every line after the first is a test case: '<input> <output> [weight]'
+int readTestCases(struct Data *data, int fd_config) {
+	char line[MAX_LINE];
+	char outputPath[MAX_LINE];
+	// the whole line, so a long test case line isn't split in two
+	int ret = getNextLine(fd_config, line, MAX_LINE);
+	if (ret == ERROR) { return ERROR; }
+	if (access(line, F_OK) == SUCCESS || strpbrk(line, " \t") == NULL) {
+		// the old format - an input path line and an output path line
+		if (getNextLine(fd_config, outputPath, MAX_LINE) == ERROR) { return ERROR; }
+		if (strlen(line) >= MAX_PATH || strlen(outputPath) >= MAX_PATH) {
+			printCustomError("Invalid test case line");
+			return ERROR;
+		}
+		return addTestCase(data, line, outputPath, 1);
+	}
+
+	while (ret != END_OF_FILE) {
+		char inputPath[MAX_LINE];
+		char flag[MAX_LINE];
+		int weight = 1;
+		int fields = sscanf(line, "%s %s %d %s", inputPath, outputPath, &weight, flag);
+		if (fields > 0) {
+			if (fields < 2 || strlen(inputPath) >= MAX_PATH || strlen(outputPath) >= MAX_PATH ||
+			    (fields == 4 && strcmp(flag, "bench") != 0)) {
+				printCustomError("Invalid test case line");
+				return ERROR;
+			}
+			if (addTestCase(data, inputPath, outputPath, weight) == ERROR) { return ERROR; }
+			data->cases[data->caseCount - 1].bench = fields == 4;
+		}
+		ret = getNextLine(fd_config, line, MAX_LINE);
+		if (ret == ERROR) { return ERROR; }
+	}
+	return SUCCESS;
+}
+
+// release the correct outputs of the test cases
+void destroyTestCases(struct Data *data) {
+	int i;
+	for (i = 0; i < data->caseCount; i++) {
+		cmpFreeReference(&data->cases[i].reference);
+	}
+	data->caseCount = 0;
+}
+
+// hash everything but the student's files that a result depends on:
+// the grading rules, the comparator, the compiler, the limits and the test cases
+int hashGrading(struct Data *data) {
+	unsigned char compilerDigest[SHA256_SIZE];
+	if (hashCompiler("gcc", gccFlags, compilerDigest) == ERROR) { return ERROR; }
+
+	struct Sha256 ctx;
+	sha256Init(&ctx);
+	long long header[] = {
+		STATE_VERSION, COMPARE_VERSION, data->wallLimitMs, data->cpuLimitMs,
+		data->memoryLimitBytes, data->processLimit, data->outputFactor, data->caseCount
+	};
+	sha256Update(&ctx, header, sizeof(header));
+	sha256Update(&ctx, compilerDigest, SHA256_SIZE);
+	int i;
+	for (i = 0; i < data->caseCount; i++) {
+		struct TestCase *testCase = &data->cases[i];
+		sha256Update(&ctx, &testCase->weight, sizeof(testCase->weight));
+		// only the tiers make the speed part of the grade
+		if (testCase->bench && data->tierCount > 0) {
+			sha256Update(&ctx, data->tiers, data->tierCount * sizeof(struct SpeedTier));
+		}
+		if (sha256File(&ctx, testCase->inputFilePath) == ERROR) { return ERROR; }
+		sha256Update(&ctx, &testCase->reference.rawLen, sizeof(testCase->reference.rawLen));
+		sha256Update(&ctx, testCase->reference.raw, testCase->reference.rawLen);
+	}
+	sha256Final(&ctx, data->gradingDigest);
+	return SUCCESS;
+}
+
+// the files of a student's directory, except for the binary we create there
+int isStudentFile(const struct dirent *entry) {
+	return entry->d_type != DT_DIR && !isStudentBinFile(entry->d_name);
+}
+
+// hash the student's files (names and contents, in name order) along with the grading digest
+// the result is reused as long as the fingerprint stays the same
+int studentFingerprint(struct Data *data, const char *dirPath, char fingerprint[SHA256_HEX_SIZE]) {
+	struct dirent **entries;
+	int count = scandir(dirPath, &entries, isStudentFile, alphasort);
+	if (count == ERROR) {
+		printError("scandir");
+		return ERROR;
+	}
+
+	struct Sha256 ctx;
+	sha256Init(&ctx);
+	sha256Update(&ctx, data->gradingDigest, SHA256_SIZE);
+	int status = SUCCESS;
+	int i;
+	for (i = 0; i < count; i++) {
+		char path[MAX_PATH + sizeof(entries[i]->d_name) + 1];
+		snprintf(path, sizeof(path), "%s/%s", dirPath, entries[i]->d_name);
+		sha256String(&ctx, entries[i]->d_name);
+		if (status == SUCCESS && sha256File(&ctx, path) == ERROR) { status = ERROR; }
+		free(entries[i]);
+	}
+	free(entries);
+	if (status == ERROR) { return ERROR; }
+
+	unsigned char digest[SHA256_SIZE];
+	sha256Final(&ctx, digest);
+	hashToHex(digest, fingerprint);
+	return SUCCESS;
+}
+
+// read the config file and initialize data's fields
+int initData(struct Data *data, int fd_config) {
+	data->caseCount = 0;
+	data->totalWeight = 0;
+	// read paths from config file
+	if (getNextLine(fd_config, data->mainDirPath, MAX_PATH) == ERROR ||
+	    checkConfigFile(data->mainDirPath, "Not a valid directory") == ERROR) {
+		return ERROR;
+	}
+	// check that the test cases' files exist and load their correct outputs
+	if (readTestCases(data, fd_config) == ERROR) {
+		destroyTestCases(data);
+		return ERROR;
+	}
+	// '--bench' measures the cases marked with 'bench' - or all of them if none is marked
+	int i, marked = FALSE;
+	for (i = 0; i < data->caseCount; i++) {
+		if (data->cases[i].bench) { marked = TRUE; }
+	}
+	for (i = 0; i < data->caseCount; i++) {
+		data->cases[i].bench = data->benchRuns > 0 && (data->cases[i].bench || !marked);
+	}
+	// workers prove that they grade like the coordinator with the digest of the grading setup
+	int remote = data->serveAddress[0] != '\0' || data->connectAddress[0] != '\0';
+	if (remote && hashGrading(data) == ERROR) {
+		printCustomError("Can't hash the grading setup");
+		destroyTestCases(data);
+		return ERROR;
+	}
+	// create errors.txt file and save its path
+	// only this process writes to it, so keep it open until destroyData
+	// (a worker appends to it instead - the coordinator and other workers may share it)
+	strcpy(data->errorFilePath, "./errors.txt");
+	int errorFlags = data->connectAddress[0] != '\0' ? O_APPEND : O_TRUNC;
+	data->fd_error = open(data->errorFilePath, O_WRONLY | O_CREAT | errorFlags | O_CLOEXEC, FILE_MODE);
+	if (data->fd_error == ERROR) { 
+		printError("open");
+		destroyTestCases(data);
+		return ERROR; 
+	}
+	if (pthread_mutex_init(&data->errorLock, NULL) != SUCCESS) {
+		printError("pthread_mutex_init");
+		close(data->fd_error);
+		destroyTestCases(data);
+		return ERROR;
+	}
+	// benchmark.csv is shared the same way
+	data->fd_bench = ERROR;
+	if (data->benchRuns > 0) {
+		data->fd_bench = open(BENCH_FILE_PATH, O_WRONLY | O_CREAT | errorFlags | O_CLOEXEC, FILE_MODE);
+		if (data->fd_bench == ERROR) {
+			printError("open");
+			pthread_mutex_destroy(&data->errorLock);
+			close(data->fd_error);
+			destroyTestCases(data);
+			return ERROR;
+		}
+	}
+	pthread_mutex_init(&data->benchLock, NULL);
+
+	// open the compile cache (if requested)
+	// we can still grade without it, so only report the failure
+	data->cache.enabled = FALSE;
+	if (data->cacheDirPath[0] != '\0' &&
+	    cacheInit(&data->cache, data->cacheDirPath, data->cacheMaxBytes, "gcc", gccFlags) == ERROR) {
+		printCustomError("Can't use the compile cache");
+		cacheDestroy(&data->cache);
+	}
+
+	// load the previous results (if requested)
+	// without them, everyone is simply graded again
+	data->state.enabled = FALSE;
+	if (data->statePath[0] != '\0' &&
+	    (stateLoad(&data->state, data->statePath) == ERROR || (!remote && hashGrading(data) == ERROR))) {
+		printCustomError("Can't use the state file");
+		stateDestroy(&data->state);
+	}
+
+	// fork the runners (if requested) while we're still single-threaded
+	// one per worker - we can start the programs ourselves if that fails
+	// (a coordinator doesn't run any programs)
+	data->runners.enabled = FALSE;
+	if (data->useRunners && data->serveAddress[0] == '\0') {
+		struct SpawnAttr attr;
+		initRunAttr(data, &attr);
+		const char *inputPaths[MAX_CASES];
+		for (i = 0; i < data->caseCount; i++) {
+			inputPaths[i] = data->cases[i].inputFilePath;
+		}
+		if (runnerPoolInit(&data->runners, data->jobs, &attr, inputPaths, data->caseCount) == ERROR) {
+			printCustomError("Can't start the runners");
+		}
+	}
+
+	return SUCCESS;
+}
+
+// release the resources acquired in initData
+int destroyData(struct Data *data) {
+	if (data->runners.enabled) { runnerPoolDestroy(&data->runners); }
+	cacheDestroy(&data->cache);
+	stateDestroy(&data->state);
+	destroyTestCases(data);
+	pthread_mutex_destroy(&data->errorLock);
+	pthread_mutex_destroy(&data->benchLock);
+	if (data->fd_bench != ERROR) { close(data->fd_bench); }
+	if (close(data->fd_error) == ERROR) {
+		printError("close");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+// initialize the student's paths and create its binary and its private error log
+// both are memfds - grading doesn't write to the (possibly network-mounted) course directory
+// and they're gone even if we crash
+int initStudentTempFiles(struct Data *data, struct StudentData *sData, const char *name) {
+	buildPath(sData->dirPath, data->mainDirPath, name);
+	memset(&sData->compileUsage, 0, sizeof(struct Usage));
+	memset(&sData->runUsage, 0, sizeof(struct Usage));
+	memset(&sData->times, 0, sizeof(struct PhaseTimes));
+	sData->runs = calloc(data->caseCount, sizeof(struct Run));
+	if (sData->runs == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+
+	sData->fd_error = memfd_create("errors", MFD_CLOEXEC);
+	if (sData->fd_error == ERROR) {
+		printError("memfd_create");
+		free(sData->runs);
+		return ERROR;
+	}
+	sData->fd_bin = memfd_create("a.out", MFD_CLOEXEC);
+	if (sData->fd_bin == ERROR) {
+		printError("memfd_create");
+		close(sData->fd_error);
+		free(sData->runs);
+		return ERROR;
+	}
+	snprintf(sData->binFilePath, sizeof(sData->binFilePath), "/proc/self/fd/%d", sData->fd_bin);
+	return SUCCESS;
+}
+
+// append the student's log to errors.txt (in one piece) and close it
+int destroyStudentTempFiles(struct Data *data, struct StudentData *sData) {
+	int status = SUCCESS;
+	if (lseek(sData->fd_error, 0, SEEK_SET) == ERROR) {
+		printError("lseek");
+		status = ERROR;
+	}
+
+	pthread_mutex_lock(&data->errorLock);
+	char buf[BUFSIZ];
+	ssize_t bytes;
+	while (status == SUCCESS && (bytes = read(sData->fd_error, buf, sizeof(buf))) != 0) {
+		if (bytes == ERROR) {
+			printError("read");
+			status = ERROR;
+		} else if (write(data->fd_error, buf, bytes) != bytes) {
+			printError("write");
+			status = ERROR;
+		}
+	}
+	pthread_mutex_unlock(&data->errorLock);
+
+	if (close(sData->fd_error) == ERROR || close(sData->fd_bin) == ERROR) {
+		printError("close");
+		status = ERROR;
+	}
+	free(sData->runs);
+	return status;
+}
+
+// helper function to get the appropriate reason for a grade
+const char *getReason(int reason) {
+	switch(reason) {
+	case PARTIAL:           return "PARTIAL";
+	case NO_C_FILE:         return "NO_C_FILE";
+	case COMPILATION_ERROR: return "COMPILATION_ERROR";
+	case OUTPUT_LIMIT:      return "OUTPUT_LIMIT";
+	case TIMEOUT:           return "TIMEOUT";
+	case WRONG:             return "WRONG";
+	case SIMILAR:           return "SIMILAR";
+	case EXCELLENT:         return "EXCELLENT";
+	default:                return "No reason";
+	}
+}
+
+// this function builds the student's line in results.csv (into result->row)
+// name, grade and reason, followed by the resources used by the student's program:
+// wall time, user and system CPU (in ms), max RSS (in KB), voluntary and involuntary
+// context switches, minor and major page faults, and finally gcc's wall time (in ms)
+void formatResult(const char *name, struct Result *result) {
+	const char *reason = getReason(result->reason);
+	const struct Usage *run = &result->runUsage;
+
+	// snprintf truncates (and null-terminates) overly long lines
+	snprintf(result->row, sizeof(result->row), "%s,%d,%s,%.3f,%.3f,%.3f,%ld,%ld,%ld,%ld,%ld,%.3f",
+	                   name, result->grade, reason,
+	                   run->wallUsec / (double)USEC_PER_MSEC,
+	                   run->userUsec / (double)USEC_PER_MSEC,
+	                   run->sysUsec / (double)USEC_PER_MSEC,
+	                   run->maxRssKb, run->voluntarySwitches, run->involuntarySwitches,
+	                   run->minorFaults, run->majorFaults,
+	                   result->compileUsage.wallUsec / (double)USEC_PER_MSEC);
+}
+
+// this function goes through the whole process of testing and grading one student
+// return the reason for the grade - sData->grade holds the grade itself
+int gradeStudent(struct Data *data, struct StudentData *sData) {	
+	// time every phase
+	long long mark = profileNow();
+	// unless the program runs, the reason is the grade
+	sData->grade = ERROR;
+	// make sure the code file exists
+	char codeFileName[MAX_PATH];
+	int found = findFile(codeFileName, sData->dirPath, isCodeFile);
+	sData->times.usec[PHASE_FIND] = profileLap(&mark);
+	if (found == FALSE) {
+		sData->grade = NO_C_FILE;
+		return NO_C_FILE;
+	}
+	// save its path
+	buildPath(sData->codeFilePath, sData->dirPath, codeFileName);
+
+	// make sure the code compiles
+	int compilationStatus = compileCode(data, sData);
+	sData->times.usec[PHASE_COMPILE] = profileLap(&mark);
+	switch (compilationStatus) {
+	case ERROR:
+	case COMPILATION_ERROR:
+		sData->grade = compilationStatus;
+		return compilationStatus;
+	}
+
+	// run the program on all of the test cases (the output is compared as it's printed)
+	int ranSuccessfully = runCode(data, sData);
+	sData->times.usec[PHASE_RUN] = profileLap(&mark);
+	if (ranSuccessfully == ERROR) { return ERROR; }
+
+	// combine the verdicts of the comparisons to the correct outputs
+	int compareResult = compareOutputs(data, sData);
+	sData->times.usec[PHASE_COMPARE] = profileLap(&mark);
+
+	// if we got here - no errors were found 
+	return compareResult;
+}
+
+// append a student to the list (their result is filled in once they're graded)
+int addStudent(struct StudentList *list, const char *name) {
+	// grow the list if needed
+	if (list->size == list->capacity) {
+		int capacity = list->capacity ? list->capacity * 2 : 64;
+		char **names = realloc(list->names, capacity * sizeof(char *));
+		if (names == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		list->names = names;
+		struct Result *results = realloc(list->results, capacity * sizeof(struct Result));
+		if (results == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		list->results = results;
+		list->capacity = capacity;
+	}
+	list->names[list->size] = strdup(name);
+	if (list->names[list->size] == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	list->results[list->size].reason = ERROR;
+	list->size++;
+	return SUCCESS;
+}
+
+// the index of a student in the list (or ERROR if they're not in it)
+int findStudent(struct StudentList *list, const char *name) {
+	int i;
+	for (i = 0; i < list->size; i++) {
+		if (strcmp(list->names[i], name) == 0) { return i; }
+	}
+	return ERROR;
+}
+
+// take a student out of the list (keeping the order of the others)
+void removeStudent(struct StudentList *list, int index) {
+	free(list->names[index]);
+	memmove(&list->names[index], &list->names[index + 1], (list->size - index - 1) * sizeof(char *));
+	memmove(&list->results[index], &list->results[index + 1], (list->size - index - 1) * sizeof(struct Result));
+	list->size--;
+}
+
+// read the names of all the students' directories (in readdir order)
+int scanStudents(struct StudentList *list, const char *mainDirPath) {
+	// open the directory that contains all of the students' directories
+	DIR *mainDir = opendir(mainDirPath);
+	// no need to print invalid dir path because we've already checked in init
+	if (mainDir == NULL) {
+		printError("opendir");
+		return ERROR;
 	}
 
-	// close resources
 	int status = SUCCESS;
+	struct dirent *dirEntry;
+	while (status == SUCCESS && (dirEntry = readdir(mainDir))) {
+		// we only care about directories (that aren't . or ..)
+		if (skipEntry(dirEntry)) { continue; }
+
+		status = addStudent(list, dirEntry->d_name);
+	}
+
 	if (closedir(mainDir) == ERROR) { status = ERROR; }
-	if (close(fd_results) == ERROR) { status = ERROR; }
+	return status;
+}
+
+// hand out the index of the next student to grade (or ERROR if there are none left)
+int fetchStudent(struct StudentList *list) {
+	pthread_mutex_lock(&list->lock);
+	int index = list->next < list->size ? list->next++ : ERROR;
+	pthread_mutex_unlock(&list->lock);
+	return index;
+}
+
+// reuse the student's previous result if nothing it depends on changed
+// (their fingerprint is kept in 'result' either way)
+int reuseResult(struct Data *data, const char *name, struct Result *result) {
+	result->reason = ERROR;
+	result->reused = FALSE;
+	result->fingerprint[0] = '\0';
+	if (!data->state.enabled) { return FALSE; }
+
+	char dirPath[MAX_PATH];
+	buildPath(dirPath, data->mainDirPath, name);
+	if (studentFingerprint(data, dirPath, result->fingerprint) == ERROR) {
+		result->fingerprint[0] = '\0';
+	}
+	const char *row = stateLookup(&data->state, name, result->fingerprint);
+	if (row == NULL) { return FALSE; }
+	snprintf(result->row, sizeof(result->row), "%s", row);
+	result->reason = SUCCESS;
+	result->reused = TRUE;
+	return TRUE;
+}
+
+// compile, run and compare a student's program and fill in their result
+// (result->reason is ERROR if they couldn't be graded)
+void gradeResult(struct Data *data, const char *name, struct Runner *runner, struct Result *result) {
+	struct StudentData sData;
+	result->reason = ERROR;
+	if (initStudentTempFiles(data, &sData, name) == ERROR) { return; }
+	sData.runner = runner;
+	// get the user's grade
+	int reason = gradeStudent(data, &sData);
+	long long mark = profileNow();
+	if (destroyStudentTempFiles(data, &sData) == ERROR) { reason = ERROR; }
+	sData.times.usec[PHASE_CLEANUP] = profileLap(&mark);
+	result->reason = reason;
+	result->times = sData.times;
+	result->grade = sData.grade;
+	result->compileUsage = sData.compileUsage;
+	result->runUsage = sData.runUsage;
+	formatResult(name, result);
+}
+
+// the 'main' function of the workers
+// every worker grades students until there are none left
+void *gradeWorker(void *arg) {
+	struct StudentList *list = arg;
+	struct Data *data = list->data;
+	// every worker has a runner of its own
+	struct Runner *runner = data->runners.enabled ? runnerAcquire(&data->runners) : NULL;
+	int index;
+	while ((index = fetchStudent(list)) != ERROR) {
+		// each worker writes to its own slot - no locking needed
+		struct Result *result = &list->results[index];
+		if (reuseResult(data, list->names[index], result)) { continue; }
+		gradeResult(data, list->names[index], runner, result);
+	}
+	if (runner != NULL) { runnerRelease(&data->runners, runner); }
+	return NULL;
+}
+
+// grade all of the students using 'data->jobs' workers
+// the current thread is one of the workers
+int runWorkers(struct StudentList *list, int jobs) {
+	if (jobs > list->size) { jobs = list->size; }
+	pthread_t *threads = NULL;
+	int created = 0;
+	if (jobs > 1) {
+		threads = malloc((jobs - 1) * sizeof(pthread_t));
+		if (threads == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		for (created = 0; created < jobs - 1; created++) {
+			if (pthread_create(&threads[created], NULL, gradeWorker, list) != SUCCESS) {
+				// the workers we've already created can finish the job
+				printError("pthread_create");
+				break;
+			}
+		}
+	}
+
+	gradeWorker(list);
+
+	int i;
+	for (i = 0; i < created; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	return SUCCESS;
+}
+
+void destroyStudentList(struct StudentList *list) {
+	int i;
+	for (i = 0; i < list->size; i++) {
+		free(list->names[i]);
+	}
+	free(list->names);
+	free(list->results);
+	pthread_mutex_destroy(&list->lock);
+}
+
+// print the grading profile and write the per-student log (if requested)
+// only the students that were actually graded count
+int writeProfile(struct Data *data, struct StudentList *list, long long scanUsec) {
+	if (data->profileSlowest == 0 && data->profileLogPath[0] == '\0') { return SUCCESS; }
+	char **names = malloc((list->size + 1) * sizeof(char *));
+	struct PhaseTimes *times = malloc((list->size + 1) * sizeof(struct PhaseTimes));
+	if (names == NULL || times == NULL) {
+		printCustomError("Out of memory");
+		free(names);
+		free(times);
+		return ERROR;
+	}
+
+	int status = SUCCESS;
+	FILE *log = NULL;
+	if (data->profileLogPath[0] != '\0') {
+		log = fopen(data->profileLogPath, "we");
+		if (log == NULL) {
+			printError("fopen");
+			status = ERROR;
+		}
+	}
+	int count = 0;
+	int i;
+	for (i = 0; i < list->size; i++) {
+		struct Result *result = &list->results[i];
+		if (result->reason == ERROR || result->reused) { continue; }
+		names[count] = list->names[i];
+		times[count++] = result->times;
+		if (log != NULL && profileLogLine(log, list->names[i], result->grade,
+		                                  getReason(result->reason), &result->times) == ERROR) {
+			status = ERROR;
+		}
+	}
+	if (log != NULL && fclose(log) == EOF) {
+		printError("fclose");
+		status = ERROR;
+	}
+	if (data->profileSlowest > 0) {
+		profileReport(stdout, names, times, count, data->profileSlowest, scanUsec);
+	}
+	free(names);
+	free(times);
+	return status;
+}
+
+int initStudentList(struct StudentList *list, struct Data *data) {
+	memset(list, 0, sizeof(*list));
+	list->data = data;
+	if (pthread_mutex_init(&list->lock, NULL) != SUCCESS) {
+		printError("pthread_mutex_init");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+// write results.csv (and save the state, if requested)
+// the rows go to a temporary file that's renamed over results.csv,
+// so a reader sees either the old results or the new ones - never half of them
+int writeResults(struct Data *data, struct StudentList *list) {
+	int fd_results = open(RESULTS_TEMP_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_MODE);
+	if (fd_results == ERROR) {
+		printError("open");
+		return ERROR;
+	}
+
+	int status = SUCCESS;
+	// the new state replaces the old one only if everything was written
+	int saveState = data->state.enabled && stateBegin(&data->state) == SUCCESS;
+
+	int i;
+	for (i = 0; status == SUCCESS && i < list->size; i++) {
+		struct Result *result = &list->results[i];
+		if (result->reason == ERROR) { continue; }
+		// finally, write the grade and reason into the csv file
+		if (dprintf(fd_results, "%s\n", result->row) < 0) {
+			printError("write");
+			status = ERROR;
+		}
+		// the student's result (new or reused) is saved for the next run
+		if (saveState && result->fingerprint[0] != '\0' &&
+		    stateWrite(&data->state, list->names[i], result->fingerprint, result->row) == ERROR) {
+			stateAbort(&data->state);
+			saveState = FALSE;
+		}
+	}
+
+	if (status == SUCCESS && fsync(fd_results) == ERROR) {
+		printError("fsync");
+		status = ERROR;
+	}
+	if (close(fd_results) == ERROR) {
+		printError("close");
+		status = ERROR;
+	}
+	if (status == SUCCESS && rename(RESULTS_TEMP_PATH, RESULTS_PATH) == ERROR) {
+		printError("rename");
+		status = ERROR;
+	}
+	if (status == ERROR) { unlink(RESULTS_TEMP_PATH); }
+
+	if (saveState && (status == ERROR || stateCommit(&data->state) == ERROR)) {
+		stateAbort(&data->state);
+		printCustomError("Can't save the state file");
+	}
+	return status;
+}
+
+int startGrading(struct Data *data) {
+	struct StudentList list;
+	if (initStudentList(&list, data) == ERROR) { return ERROR; }
+
+	// find all the students first, so the results can be written in directory order
+	// no matter in which order the workers finish
+	long long scanStart = profileNow();
+	if (scanStudents(&list, data->mainDirPath) == ERROR) {
+		destroyStudentList(&list);
+		return ERROR;
+	}
+	long long scanUsec = profileNow() - scanStart;
+
+	int status = runWorkers(&list, data->jobs);
+	if (status == SUCCESS) { status = writeResults(data, &list); }
+	if (status == SUCCESS) { writeProfile(data, &list, scanUsec); }
+
+	// close resources
+	destroyStudentList(&list);
+	return status;
+}
+
+static volatile sig_atomic_t stopWatching = FALSE;
+
+static void onStopSignal(int sig) {
+	(void)sig;
+	stopWatching = TRUE;
+}
+
+// grade the students whose directories changed (or appeared) and update the roster
+int gradeChanges(struct Data *data, struct StudentList *roster, struct WatchChange *changes, int count) {
+	struct StudentList batch;
+	if (initStudentList(&batch, data) == ERROR) { return ERROR; }
+
+	int status = SUCCESS;
+	int i;
+	for (i = 0; status == SUCCESS && i < count; i++) {
+		int index = findStudent(roster, changes[i].name);
+		if (changes[i].removed) {
+			if (index != ERROR) { removeStudent(roster, index); }
+		} else {
+			status = addStudent(&batch, changes[i].name);
+		}
+	}
+	if (status == SUCCESS) { status = runWorkers(&batch, data->jobs); }
+
+	// new students go to the end, the others keep their place
+	for (i = 0; status == SUCCESS && i < batch.size; i++) {
+		// a student that couldn't be graded keeps their previous row
+		if (batch.results[i].reason == ERROR) { continue; }
+		int index = findStudent(roster, batch.names[i]);
+		if (index == ERROR) {
+			if (addStudent(roster, batch.names[i]) == ERROR) {
+				status = ERROR;
+				break;
+			}
+			index = roster->size - 1;
+		}
+		roster->results[index] = batch.results[i];
+		printf("graded %s: %s\n", batch.names[i], batch.results[i].row);
+	}
+	fflush(stdout);
+
+	destroyStudentList(&batch);
+	return status;
+}
+
+// grade everyone once, and then grade students again whenever their directories change
+// (until SIGINT or SIGTERM) - results.csv is rewritten after every batch
+int watchStudents(struct Data *data) {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onStopSignal;
+	sigemptyset(&action.sa_mask);
+	// the workers' reads and writes go on (and poll's EINTR is already handled)
+	action.sa_flags = SA_RESTART;
+	if (sigaction(SIGINT, &action, NULL) == ERROR || sigaction(SIGTERM, &action, NULL) == ERROR) {
+		printError("sigaction");
+		return ERROR;
+	}
+
+	// watch before the first pass, so nothing that changes during it is missed
+	struct Watcher watcher;
+	if (watcherInit(&watcher, data->mainDirPath, data->debounceMs) == ERROR) { return ERROR; }
+
+	struct StudentList roster;
+	if (initStudentList(&roster, data) == ERROR) {
+		watcherDestroy(&watcher);
+		return ERROR;
+	}
+	int status = scanStudents(&roster, data->mainDirPath);
+	if (status == SUCCESS) { status = runWorkers(&roster, data->jobs); }
+	if (status == SUCCESS) { status = writeResults(data, &roster); }
+	if (status == SUCCESS) {
+		printf("graded %d students, watching %s\n", roster.size, data->mainDirPath);
+		fflush(stdout);
+	}
+
+	while (status == SUCCESS && !stopWatching) {
+		if (watcherPoll(&watcher, WATCH_POLL_MS) == ERROR) {
+			status = ERROR;
+			break;
+		}
+		struct WatchChange *changes;
+		int count = watcherCollect(&watcher, &changes);
+		if (count == ERROR) {
+			status = ERROR;
+			break;
+		}
+		if (count == 0) { continue; }
+		status = gradeChanges(data, &roster, changes, count);
+		if (status == SUCCESS) { status = writeResults(data, &roster); }
+		watcherFreeChanges(changes, count);
+	}
+
+	destroyStudentList(&roster);
+	watcherDestroy(&watcher);
+	return status;
+}
+
+// a worker, as the coordinator sees it
+struct Connection {
+	int fd;
+	// TRUE once the worker's HELLO was accepted
+	int ready;
+	// the index of the student the worker grades (or ERROR)
+	int job;
+	// the last time we heard from the worker
+	long long lastSeen;
+};
+
+struct Coordinator {
+	struct Data *data;
+	struct StudentList *list;
+	struct Connection *conns;
+	int connCount;
+	int connCapacity;
+	// the students waiting for a worker (a ring of indexes)
+	int *queue;
+	int queueHead;
+	int queueSize;
+	// how many workers were lost while grading each student
+	int *attempts;
+	// the students that are neither graded nor given up on
+	int remaining;
+};
+
+void enqueueJob(struct Coordinator *coord, int index) {
+	coord->queue[(coord->queueHead + coord->queueSize) % coord->list->size] = index;
+	coord->queueSize++;
+}
+
+// send the next student to an idle worker (if there is one waiting)
+int assignJob(struct Coordinator *coord, struct Connection *conn) {
+	if (!conn->ready || conn->job != ERROR || coord->queueSize == 0) { return SUCCESS; }
+	int index = coord->queue[coord->queueHead];
+	coord->queueHead = (coord->queueHead + 1) % coord->list->size;
+	coord->queueSize--;
+	// the job's id is the student's index, so a late result can't be taken for someone else's
+	conn->job = index;
+	struct RemoteFrame frame;
+	frameInit(&frame, REMOTE_JOB);
+	if (framePut32(&frame, index) == ERROR || framePutString(&frame, coord->list->names[index]) == ERROR) {
+		return ERROR;
+	}
+	return remoteSend(conn->fd, &frame);
+}
+
+// forget a worker - the student it was grading goes back to the queue
+void dropConnection(struct Coordinator *coord, int i) {
+	struct Connection *conn = &coord->conns[i];
+	close(conn->fd);
+	int index = conn->job;
+	if (index != ERROR) {
+		if (++coord->attempts[index] < MAX_JOB_ATTEMPTS) {
+			enqueueJob(coord, index);
+		} else {
+			// the student's program probably takes the workers down with it
+			fprintf(stderr, "Giving up on %s: lost %d workers while grading it\n",
+			        coord->list->names[index], coord->attempts[index]);
+			coord->remaining--;
+		}
+	}
+	coord->conns[i] = coord->conns[--coord->connCount];
+}
+
+int addConnection(struct Coordinator *coord, int fd) {
+	if (coord->connCount == coord->connCapacity) {
+		int capacity = coord->connCapacity ? coord->connCapacity * 2 : 16;
+		struct Connection *conns = realloc(coord->conns, capacity * sizeof(struct Connection));
+		if (conns == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		coord->conns = conns;
+		coord->connCapacity = capacity;
+	}
+	struct Connection *conn = &coord->conns[coord->connCount++];
+	conn->fd = fd;
+	conn->ready = FALSE;
+	conn->job = ERROR;
+	conn->lastSeen = profileNow();
+	return SUCCESS;
+}
+
+// handle a frame from a worker (ERROR if the worker should be dropped)
+int handleFrame(struct Coordinator *coord, struct Connection *conn, struct RemoteFrame *frame) {
+	if (frame->type == REMOTE_HEARTBEAT) { return SUCCESS; }
+
+	if (frame->type == REMOTE_HELLO && !conn->ready) {
+		uint32_t version;
+		unsigned char digest[SHA256_SIZE];
+		if (frameGet32(frame, &version) == ERROR || frameGetBytes(frame, digest, SHA256_SIZE) == ERROR) {
+			return ERROR;
+		}
+		if (version != REMOTE_VERSION || memcmp(digest, coord->data->gradingDigest, SHA256_SIZE) != 0) {
+			printCustomError("Rejected a worker with a different version or grading setup");
+			struct RemoteFrame reject;
+			frameInit(&reject, REMOTE_REJECT);
+			remoteSend(conn->fd, &reject);
+			return ERROR;
+		}
+		conn->ready = TRUE;
+		return assignJob(coord, conn);
+	}
+
+	if (frame->type == REMOTE_RESULT && conn->job != ERROR) {
+		uint32_t id, grade, reason;
+		if (frameGet32(frame, &id) == ERROR || id != (uint32_t)conn->job ||
+		    frameGet32(frame, &grade) == ERROR || frameGet32(frame, &reason) == ERROR) {
+			return ERROR;
+		}
+		// the fingerprint was taken before the student was handed out
+		struct Result *result = &coord->list->results[conn->job];
+		int phase;
+		for (phase = 0; phase < PHASE_COUNT; phase++) {
+			uint64_t usec;
+			if (frameGet64(frame, &usec) == ERROR) { return ERROR; }
+			result->times.usec[phase] = usec;
+		}
+		if (frameGetString(frame, result->row, sizeof(result->row)) == ERROR) { return ERROR; }
+		result->grade = (int)grade;
+		result->reason = (int)reason;
+		result->reused = FALSE;
+		coord->remaining--;
+		conn->job = ERROR;
+		return assignJob(coord, conn);
+	}
+
+	return ERROR;
+}
+
+// start a worker that gets our arguments (plus '--connect')
+pid_t startLocalWorker(struct Data *data) {
+	char **argv = malloc((data->argc + 3) * sizeof(char *));
+	if (argv == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	argv[0] = data->argv[0];
+	argv[1] = "--connect";
+	argv[2] = data->serveAddress;
+	int i;
+	for (i = 1; i <= data->argc; i++) {
+		argv[i + 2] = data->argv[i];
+	}
+	struct SpawnAttr attr;
+	spawnInit(&attr);
+	pid_t pid = spawnProcess(&attr, "/proc/self/exe", argv);
+	if (pid == ERROR) { printError("spawnProcess"); }
+	free(argv);
+	return pid;
+}
+
+// TRUE once all of the local workers exited (they're reaped as they do)
+int localWorkersExited(pid_t *pids, int count) {
+	int exited = TRUE;
+	int i;
+	for (i = 0; i < count; i++) {
+		if (pids[i] != ERROR && waitpid(pids[i], NULL, WNOHANG) == 0) {
+			exited = FALSE;
+		} else {
+			pids[i] = ERROR;
+		}
+	}
+	return exited;
+}
+
+// poll the listening socket and the workers until every student is graded (or given up on)
+int coordinate(struct Coordinator *coord, int fd_listen, pid_t *localPids) {
+	struct Data *data = coord->data;
+	struct pollfd *pfds = NULL;
+	int status = SUCCESS;
+	while (status == SUCCESS && coord->remaining > 0) {
+		struct pollfd *grown = realloc(pfds, (coord->connCount + 1) * sizeof(struct pollfd));
+		if (grown == NULL) {
+			printCustomError("Out of memory");
+			status = ERROR;
+			break;
+		}
+		pfds = grown;
+		pfds[0].fd = fd_listen;
+		pfds[0].events = POLLIN;
+		int i;
+		for (i = 0; i < coord->connCount; i++) {
+			pfds[i + 1].fd = coord->conns[i].fd;
+			pfds[i + 1].events = POLLIN;
+		}
+		int polled = coord->connCount;
+		if (poll(pfds, polled + 1, HEARTBEAT_MS) == ERROR && errno != EINTR) {
+			printError("poll");
+			status = ERROR;
+			break;
+		}
+
+		// backwards, since a dropped worker is replaced by the last one (which we've already seen)
+		long long now = profileNow();
+		for (i = polled - 1; i >= 0; i--) {
+			struct Connection *conn = &coord->conns[i];
+			if (pfds[i + 1].revents != 0) {
+				struct RemoteFrame frame;
+				if (remoteReceive(conn->fd, &frame) == ERROR || handleFrame(coord, conn, &frame) == ERROR) {
+					dropConnection(coord, i);
+					continue;
+				}
+				conn->lastSeen = now;
+			} else if (now - conn->lastSeen > HEARTBEAT_TIMEOUT_MS * USEC_PER_MSEC) {
+				dropConnection(coord, i);
+			}
+		}
+		// the students of lost workers go to the idle ones
+		for (i = coord->connCount - 1; i >= 0; i--) {
+			if (assignJob(coord, &coord->conns[i]) == ERROR) { dropConnection(coord, i); }
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			int fd = remoteAccept(fd_listen, FRAME_TIMEOUT_MS);
+			if (fd != ERROR && addConnection(coord, fd) == ERROR) { close(fd); }
+		}
+
+		// nobody else is going to grade the students if we only had local workers
+		if (data->localWorkers > 0 && coord->connCount == 0 &&
+		    localWorkersExited(localPids, data->localWorkers)) {
+			printCustomError("All of the local workers exited");
+			status = ERROR;
+		}
+	}
+	free(pfds);
+	return status;
+}
+
+// hand the students out to the workers that connect to '--serve' (and the local ones)
+// results.csv is written once every student is graded
+int serveStudents(struct Data *data) {
+	struct StudentList list;
+	if (initStudentList(&list, data) == ERROR) { return ERROR; }
+	long long scanStart = profileNow();
+	if (scanStudents(&list, data->mainDirPath) == ERROR) {
+		destroyStudentList(&list);
+		return ERROR;
+	}
+	long long scanUsec = profileNow() - scanStart;
+
+	struct Coordinator coord = { 0 };
+	coord.data = data;
+	coord.list = &list;
+	coord.queue = malloc((list.size + 1) * sizeof(int));
+	coord.attempts = calloc(list.size + 1, sizeof(int));
+	pid_t *localPids = malloc((data->localWorkers + 1) * sizeof(pid_t));
+	if (coord.queue == NULL || coord.attempts == NULL || localPids == NULL) {
+		printCustomError("Out of memory");
+		free(coord.queue);
+		free(coord.attempts);
+		free(localPids);
+		destroyStudentList(&list);
+		return ERROR;
+	}
+	// the students whose previous results can be reused never reach a worker
+	int i;
+	for (i = 0; i < list.size; i++) {
+		if (reuseResult(data, list.names[i], &list.results[i])) { continue; }
+		enqueueJob(&coord, i);
+		coord.remaining++;
+	}
+
+	int status = SUCCESS;
+	int fd_listen = remoteListen(data->serveAddress);
+	if (fd_listen == ERROR) { status = ERROR; }
+	for (i = 0; i < data->localWorkers; i++) {
+		localPids[i] = status == SUCCESS ? startLocalWorker(data) : ERROR;
+	}
+	if (status == SUCCESS) { status = coordinate(&coord, fd_listen, localPids); }
+
+	// the workers still connected are done
+	for (i = 0; i < coord.connCount; i++) {
+		struct RemoteFrame frame;
+		frameInit(&frame, REMOTE_DONE);
+		remoteSend(coord.conns[i].fd, &frame);
+		close(coord.conns[i].fd);
+	}
+	if (fd_listen != ERROR) {
+		close(fd_listen);
+		remoteUnlink(data->serveAddress);
+	}
+	for (i = 0; i < data->localWorkers; i++) {
+		if (localPids[i] != ERROR) { waitpid(localPids[i], NULL, 0); }
+	}
+
+	if (status == SUCCESS) { status = writeResults(data, &list); }
+	if (status == SUCCESS) { writeProfile(data, &list, scanUsec); }
+
+	free(coord.conns);
+	free(coord.queue);
+	free(coord.attempts);
+	free(localPids);
+	destroyStudentList(&list);
+	return status;
+}
+
+// one connection to the coordinator (a worker opens '-j' of them)
+struct WorkerConnection {
+	int fd;
+	// the grading thread and the heartbeats both send on it
+	pthread_mutex_t sendLock;
+	// FALSE once the grading thread is done with it
+	int open;
+	// SUCCESS if the coordinator said it was done (and not rejected us or vanished)
+	int status;
+	struct RemoteWorker *worker;
+};
+
+struct RemoteWorker {
+	struct Data *data;
+	struct WorkerConnection *conns;
+	int count;
+	// the amount of connections still open
+	int active;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+};
+
+int sendToCoordinator(struct WorkerConnection *conn, const struct RemoteFrame *frame) {
+	pthread_mutex_lock(&conn->sendLock);
+	int status = conn->open ? remoteSend(conn->fd, frame) : ERROR;
+	pthread_mutex_unlock(&conn->sendLock);
+	return status;
+}
+
+// the name of a directory in mainDirPath (and nothing that leads out of it)
+int isStudentName(const char *name) {
+	return name[0] != '\0' && strchr(name, '/') == NULL && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+// grade the students the coordinator sends on one connection
+void *remoteWorkerThread(void *arg) {
+	struct WorkerConnection *conn = arg;
+	struct RemoteWorker *worker = conn->worker;
+	struct Data *data = worker->data;
+	struct Runner *runner = data->runners.enabled ? runnerAcquire(&data->runners) : NULL;
+
+	struct RemoteFrame frame;
+	frameInit(&frame, REMOTE_HELLO);
+	framePut32(&frame, REMOTE_VERSION);
+	framePutBytes(&frame, data->gradingDigest, SHA256_SIZE);
+	int status = sendToCoordinator(conn, &frame);
+	while (status == SUCCESS && remoteReceive(conn->fd, &frame) == SUCCESS && frame.type == REMOTE_JOB) {
+		uint32_t id;
+		char name[MAX_PATH];
+		if (frameGet32(&frame, &id) == ERROR || frameGetString(&frame, name, sizeof(name)) == ERROR ||
+		    !isStudentName(name)) {
+			status = ERROR;
+			break;
+		}
+		struct Result result;
+		result.grade = 0;
+		result.row[0] = '\0';
+		memset(&result.times, 0, sizeof(result.times));
+		gradeResult(data, name, runner, &result);
+
+		frameInit(&frame, REMOTE_RESULT);
+		framePut32(&frame, id);
+		framePut32(&frame, (uint32_t)result.grade);
+		framePut32(&frame, (uint32_t)result.reason);
+		int phase;
+		for (phase = 0; phase < PHASE_COUNT; phase++) {
+			framePut64(&frame, result.times.usec[phase]);
+		}
+		framePutString(&frame, result.reason == ERROR ? "" : result.row);
+		status = sendToCoordinator(conn, &frame);
+	}
+	if (status == SUCCESS && frame.type == REMOTE_REJECT) {
+		printCustomError("The coordinator has a different version or grading setup");
+	}
+	conn->status = status == SUCCESS && frame.type == REMOTE_DONE ? SUCCESS : ERROR;
+	if (runner != NULL) { runnerRelease(&data->runners, runner); }
+
+	pthread_mutex_lock(&conn->sendLock);
+	conn->open = FALSE;
+	pthread_mutex_unlock(&conn->sendLock);
+	pthread_mutex_lock(&worker->lock);
+	worker->active--;
+	pthread_cond_signal(&worker->done);
+	pthread_mutex_unlock(&worker->lock);
+	return NULL;
+}
+
+// connect to the coordinator (it may not be listening yet)
+int connectCoordinator(const char *address) {
+	long long deadline = profileNow() + CONNECT_TIMEOUT_MS * USEC_PER_MSEC;
+	int fd;
+	while ((fd = remoteConnect(address)) == ERROR && profileNow() < deadline) {
+		usleep(CONNECT_RETRY_MS * USEC_PER_MSEC);
+	}
+	if (fd == ERROR) { printCustomError("Can't connect to the coordinator"); }
+	return fd;
+}
+
+// grade the students a coordinator hands out, on '-j' connections at once
+// the current thread sends the heartbeats until the coordinator is done with all of them
+int workStudents(struct Data *data) {
+	struct RemoteWorker worker;
+	worker.data = data;
+	worker.count = 0;
+	worker.active = 0;
+	worker.conns = malloc(data->jobs * sizeof(struct WorkerConnection));
+	pthread_t *threads = malloc(data->jobs * sizeof(pthread_t));
+	if (worker.conns == NULL || threads == NULL) {
+		printCustomError("Out of memory");
+		free(worker.conns);
+		free(threads);
+		return ERROR;
+	}
+	pthread_mutex_init(&worker.lock, NULL);
+	pthread_cond_init(&worker.done, NULL);
+
+	while (worker.count < data->jobs) {
+		struct WorkerConnection *conn = &worker.conns[worker.count];
+		conn->fd = connectCoordinator(data->connectAddress);
+		if (conn->fd == ERROR) { break; }
+		conn->open = TRUE;
+		conn->worker = &worker;
+		pthread_mutex_init(&conn->sendLock, NULL);
+		worker.active++;
+		if (pthread_create(&threads[worker.count], NULL, remoteWorkerThread, conn) != SUCCESS) {
+			printError("pthread_create");
+			worker.active--;
+			pthread_mutex_destroy(&conn->sendLock);
+			close(conn->fd);
+			break;
+		}
+		worker.count++;
+	}
+
+	struct RemoteFrame heartbeat;
+	frameInit(&heartbeat, REMOTE_HEARTBEAT);
+	pthread_mutex_lock(&worker.lock);
+	while (worker.active > 0) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += HEARTBEAT_MS / 1000;
+		pthread_cond_timedwait(&worker.done, &worker.lock, &deadline);
+		pthread_mutex_unlock(&worker.lock);
+		int i;
+		for (i = 0; i < worker.count; i++) {
+			sendToCoordinator(&worker.conns[i], &heartbeat);
+		}
+		pthread_mutex_lock(&worker.lock);
+	}
+	pthread_mutex_unlock(&worker.lock);
+
+	int status = worker.count > 0 ? SUCCESS : ERROR;
+	int i;
+	for (i = 0; i < worker.count; i++) {
+		pthread_join(threads[i], NULL);
+		if (worker.conns[i].status == ERROR) { status = ERROR; }
+		pthread_mutex_destroy(&worker.conns[i].sendLock);
+		close(worker.conns[i].fd);
+	}
+	pthread_cond_destroy(&worker.done);
+	pthread_mutex_destroy(&worker.lock);
+	free(worker.conns);
+	free(threads);
 	return status;
 }
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ISOLATED_PATH "/sys/devices/system/cpu/isolated"
+#define USEC_PER_MSEC (1000LL)
+
+int parseTiers(const char *spec, struct SpeedTier tiers[MAX_TIERS], int *count) {
+	*count = 0;
+	const char *ptr = spec;
+	while (*ptr != '\0') {
+		if (*count == MAX_TIERS) { return ERROR; }
+		// fractions of a millisecond are fine
+		double limitMs;
+		int percent, used;
+		if (sscanf(ptr, "%lf:%d%n", &limitMs, &percent, &used) != 2 ||
+		    limitMs <= 0 || percent < 0 || percent > 100) {
+			return ERROR;
+		}
+		long long limitUsec = limitMs * USEC_PER_MSEC;
+		// the limits must grow
+		if (*count > 0 && limitUsec <= tiers[*count - 1].limitUsec) { return ERROR; }
+		tiers[*count].limitUsec = limitUsec;
+		tiers[*count].percent = percent;
+		(*count)++;
+		ptr += used;
+		if (*ptr == ',') {
+			ptr++;
+		} else if (*ptr != '\0') {
+			return ERROR;
+		}
+	}
+	return *count > 0 ? SUCCESS : ERROR;
+}
+
+int tierPercent(const struct SpeedTier tiers[], int count, long long medianUsec) {
+	int i;
+	for (i = 0; i < count; i++) {
+		if (medianUsec <= tiers[i].limitUsec) { return tiers[i].percent; }
+	}
+	return 0;
+}
+
+static int compareValues(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+static long long sortedMedian(const long long sorted[], int count) {
+	return count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+void medianMad(long long values[], int count, long long *median, long long *mad) {
+	*median = *mad = 0;
+	if (count == 0) { return; }
+	qsort(values, count, sizeof(long long), compareValues);
+	*median = sortedMedian(values, count);
+	long long *deviations = malloc(count * sizeof(long long));
+	if (deviations == NULL) { return; }
+	int i;
+	for (i = 0; i < count; i++) {
+		deviations[i] = llabs(values[i] - *median);
+	}
+	qsort(deviations, count, sizeof(long long), compareValues);
+	*mad = sortedMedian(deviations, count);
+	free(deviations);
+}
+
+int isolatedCpu(void) {
+	FILE *file = fopen(ISOLATED_PATH, "re");
+	if (file == NULL) { return ERROR; }
+	// a list like "2-3,6" - the first number is enough
+	int cpu;
+	if (fscanf(file, "%d", &cpu) != 1) { cpu = ERROR; }
+	fclose(file);
+	return cpu;
+}
+
+int counterOpen(void) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	// the children we start count too (once they exit)
+	attr.inherit = 1;
+	// counting the kernel needs more privileges (perf_event_paranoid)
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+int counterStart(int fd) {
+	return ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+long long counterStop(int fd) {
+	if (ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == ERROR) { return ERROR; }
+	// a reset doesn't clear what the exited children added, so it's a running total
+	long long count;
+	if (read(fd, &count, sizeof(count)) != sizeof(count)) { return ERROR; }
+	return count;
+}
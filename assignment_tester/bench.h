@@ -0,0 +1,33 @@
+#ifndef __BENCH__
+#define __BENCH__
+
+#include "common.h"
+
+#define MAX_TIERS (16)
+
+// a program whose median wall time is at most 'limitUsec' keeps 'percent' of the case's grade
+struct SpeedTier {
+	long long limitUsec;
+	int percent;
+};
+
+// "ms:percent,..." with increasing limits (e.g. "0.5:100,10:90,200:75")
+int parseTiers(const char *spec, struct SpeedTier tiers[MAX_TIERS], int *count);
+// the percent of the first tier 'medianUsec' fits in (0 if it's slower than all of them)
+int tierPercent(const struct SpeedTier tiers[], int count, long long medianUsec);
+
+// the median and the median absolute deviation of 'count' values (they're sorted)
+void medianMad(long long values[], int count, long long *median, long long *mad);
+
+// the first CPU the kernel keeps the scheduler off (isolcpus), or ERROR if there's none
+int isolatedCpu(void);
+
+// count the user-space instructions of this thread and the processes it starts from now on
+// (perf_event_open - ERROR if it isn't permitted or there's no PMU)
+int counterOpen(void);
+int counterStart(int fd);
+// the instructions counted while the counter was started (a running total - the children's are
+// added as they exit, so stop it after reaping them), or ERROR
+long long counterStop(int fd);
+
+#endif
@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+
+#include "cache.h"
+#include "spawn.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define BIN_MODE      (0755)
+#define COPY_SIZE     (65536)
+
+// a trim evicts entries until the cache is at 90% of its cap
+// so we don't have to scan the directory on every insertion
+#define TRIM_PERCENT  (90)
+
+// cacheStore's temporary files (see 'cacheStore')
+#define TEMP_PREFIX   "tmp."
+
+struct CacheEntry {
+	char name[SHA256_HEX_SIZE + 8];
+	struct timespec mtime;
+	long long size;
+};
+
+static void buildEntryPath(char *buf, struct CompileCache *cache, const char *key, const char *ext) {
+	snprintf(buf, MAX_CACHE_PATH, "%s/%s%s", cache->dirPath, key, ext);
+}
+
+// copy everything from 'fd_in' (starting at 'offset') to the end of 'fd_out'
+static int copyData(int fd_in, int fd_out, off_t offset) {
+	char buf[COPY_SIZE];
+	ssize_t bytes;
+	while ((bytes = pread(fd_in, buf, sizeof(buf), offset)) > 0) {
+		if (write(fd_out, buf, bytes) != bytes) { return ERROR; }
+		offset += bytes;
+	}
+	return bytes == ERROR ? ERROR : SUCCESS;
+}
+
+int hashCompiler(const char *compiler, char *const flags[], unsigned char digest[SHA256_SIZE]) {
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == ERROR) {
+		printError("pipe2");
+		return ERROR;
+	}
+	struct SpawnAttr attr;
+	spawnInit(&attr);
+	attr.searchPath = TRUE;
+	spawnRedirect(&attr, fds[1], STDOUT_FILENO);
+	char *argv[] = { (char *)compiler, "--version", NULL };
+	pid_t pid = spawnProcess(&attr, compiler, argv);
+	close(fds[1]);
+	if (pid == ERROR) {
+		printError("spawnProcess");
+		close(fds[0]);
+		return ERROR;
+	}
+
+	struct Sha256 ctx;
+	sha256Init(&ctx);
+	char buf[COPY_SIZE];
+	ssize_t bytes;
+	while ((bytes = read(fds[0], buf, sizeof(buf))) > 0) {
+		sha256Update(&ctx, buf, bytes);
+	}
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) == ERROR || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printCustomError("Can't get the compiler's version");
+		return ERROR;
+	}
+
+	int i;
+	for (i = 0; flags[i] != NULL; i++) {
+		sha256String(&ctx, flags[i]);
+	}
+	sha256Final(&ctx, digest);
+	return SUCCESS;
+}
+
+// sum the sizes of the files in the cache directory
+static int measureCache(struct CompileCache *cache) {
+	DIR *dir = opendir(cache->dirPath);
+	if (dir == NULL) {
+		printError("opendir");
+		return ERROR;
+	}
+	cache->totalBytes = 0;
+	struct dirent *entry;
+	struct stat st;
+	while ((entry = readdir(dir))) {
+		if (fstatat(dirfd(dir), entry->d_name, &st, 0) == SUCCESS && S_ISREG(st.st_mode)) {
+			cache->totalBytes += st.st_size;
+		}
+	}
+	closedir(dir);
+	return SUCCESS;
+}
+
+int cacheInit(struct CompileCache *cache, const char *dirPath, long long maxBytes,
+              const char *compiler, char *const flags[]) {
+	cache->enabled = FALSE;
+	strcpy(cache->dirPath, dirPath);
+	cache->maxBytes = maxBytes;
+	if (mkdir(dirPath, BIN_MODE) == ERROR && errno != EEXIST) {
+		printError("mkdir");
+		return ERROR;
+	}
+	if (hashCompiler(compiler, flags, cache->compilerDigest) == ERROR ||
+	    measureCache(cache) == ERROR) {
+		return ERROR;
+	}
+	if (pthread_mutex_init(&cache->lock, NULL) != SUCCESS) {
+		printError("pthread_mutex_init");
+		return ERROR;
+	}
+	cache->enabled = TRUE;
+	return cacheTrim(cache);
+}
+
+void cacheDestroy(struct CompileCache *cache) {
+	if (cache->enabled) {
+		pthread_mutex_destroy(&cache->lock);
+		cache->enabled = FALSE;
+	}
+}
+
+int cacheKey(struct CompileCache *cache, const char *codeFilePath,
+             int (*isSourceFile)(const struct dirent *), char key[SHA256_HEX_SIZE]) {
+	struct Sha256 ctx;
+	sha256Init(&ctx);
+	sha256Update(&ctx, cache->compilerDigest, SHA256_SIZE);
+	// the path is part of the key because it shows up in gcc's messages (and in __FILE__)
+	sha256String(&ctx, codeFilePath);
+	if (sha256File(&ctx, codeFilePath) == ERROR) {
+		printError("read");
+		return ERROR;
+	}
+
+	// the code may include the student's other files, so they count too (names and contents, in name order)
+	char dirPath[MAX_PATH];
+	strcpy(dirPath, codeFilePath);
+	struct dirent **entries;
+	int count = scandir(dirname(dirPath), &entries, isSourceFile, alphasort);
+	if (count == ERROR) {
+		printError("scandir");
+		return ERROR;
+	}
+	int status = SUCCESS;
+	int i;
+	for (i = 0; i < count; i++) {
+		char path[MAX_PATH + sizeof(entries[i]->d_name) + 1];
+		snprintf(path, sizeof(path), "%s/%s", dirPath, entries[i]->d_name);
+		sha256String(&ctx, entries[i]->d_name);
+		if (status == SUCCESS && strcmp(path, codeFilePath) != 0 && sha256File(&ctx, path) == ERROR) {
+			printError("read");
+			status = ERROR;
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	if (status == ERROR) { return ERROR; }
+
+	unsigned char digest[SHA256_SIZE];
+	sha256Final(&ctx, digest);
+	hashToHex(digest, key);
+	return SUCCESS;
+}
+
+// copy an entry to the end of 'fd_out' (and bump its mtime - the LRU order is based on it)
+static int copyEntry(struct CompileCache *cache, const char *key, const char *ext, int fd_out) {
+	char entryPath[MAX_CACHE_PATH];
+	buildEntryPath(entryPath, cache, key, ext);
+	int fd_entry = open(entryPath, O_RDONLY | O_CLOEXEC);
+	if (fd_entry == ERROR) { return ERROR; }
+	int status = copyData(fd_entry, fd_out, 0);
+	close(fd_entry);
+	if (status == ERROR) { return ERROR; }
+	utimensat(AT_FDCWD, entryPath, NULL, 0);
+	return SUCCESS;
+}
+
+enum CacheStatus cacheLookup(struct CompileCache *cache, const char *key, int fd_bin, int fd_log) {
+	if (copyEntry(cache, key, ".bin", fd_bin) == SUCCESS) { return CACHE_BINARY; }
+	// drop whatever part of the binary was copied
+	if (ftruncate(fd_bin, 0) == ERROR || lseek(fd_bin, 0, SEEK_SET) == ERROR) { return CACHE_MISS; }
+	if (copyEntry(cache, key, ".err", fd_log) == SUCCESS) { return CACHE_COMPILE_ERROR; }
+	return CACHE_MISS;
+}
+
+int cacheStore(struct CompileCache *cache, const char *key, int fd_bin, int fd_log, off_t logStart) {
+	// write the entry to a temporary file and rename it into place
+	// so concurrent graders never see a partially written entry
+	char tempPath[MAX_CACHE_PATH];
+	snprintf(tempPath, sizeof(tempPath), "%s/" TEMP_PREFIX "XXXXXX", cache->dirPath);
+	int fd_temp = mkostemp(tempPath, O_CLOEXEC);
+	if (fd_temp == ERROR) {
+		printError("mkostemp");
+		return ERROR;
+	}
+
+	int status = SUCCESS;
+	if (fd_bin != ERROR) {
+		if (copyData(fd_bin, fd_temp, 0) == ERROR || fchmod(fd_temp, BIN_MODE) == ERROR) {
+			status = ERROR;
+		}
+	} else if (copyData(fd_log, fd_temp, logStart) == ERROR) {
+		status = ERROR;
+	}
+	struct stat st;
+	if (fstat(fd_temp, &st) == ERROR) { status = ERROR; }
+	if (close(fd_temp) == ERROR) { status = ERROR; }
+
+	char entryPath[MAX_CACHE_PATH];
+	buildEntryPath(entryPath, cache, key, fd_bin != ERROR ? ".bin" : ".err");
+	if (status == ERROR || rename(tempPath, entryPath) == ERROR) {
+		printError("cacheStore");
+		unlink(tempPath);
+		return ERROR;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	cache->totalBytes += st.st_size;
+	int full = cache->totalBytes > cache->maxBytes;
+	pthread_mutex_unlock(&cache->lock);
+	return full ? cacheTrim(cache) : SUCCESS;
+}
+
+static int compareEntryAge(const void *first, const void *second) {
+	const struct CacheEntry *a = first;
+	const struct CacheEntry *b = second;
+	if (a->mtime.tv_sec != b->mtime.tv_sec) {
+		return a->mtime.tv_sec < b->mtime.tv_sec ? -1 : 1;
+	}
+	if (a->mtime.tv_nsec != b->mtime.tv_nsec) {
+		return a->mtime.tv_nsec < b->mtime.tv_nsec ? -1 : 1;
+	}
+	return 0;
+}
+
+int cacheTrim(struct CompileCache *cache) {
+	pthread_mutex_lock(&cache->lock);
+	// another thread may have trimmed it already
+	if (cache->totalBytes <= cache->maxBytes) {
+		pthread_mutex_unlock(&cache->lock);
+		return SUCCESS;
+	}
+
+	DIR *dir = opendir(cache->dirPath);
+	if (dir == NULL) {
+		printError("opendir");
+		pthread_mutex_unlock(&cache->lock);
+		return ERROR;
+	}
+	// collect the entries and sort them from least to most recently used
+	struct CacheEntry *entries = NULL;
+	int size = 0, capacity = 0;
+	long long totalBytes = 0;
+	struct dirent *dirEntry;
+	struct stat st;
+	while ((dirEntry = readdir(dir))) {
+		// another thread's (or grader's) entry that's still being written
+		if (strncmp(dirEntry->d_name, TEMP_PREFIX, strlen(TEMP_PREFIX)) == 0 ||
+		    strlen(dirEntry->d_name) >= sizeof(entries->name) ||
+		    fstatat(dirfd(dir), dirEntry->d_name, &st, 0) == ERROR ||
+		    !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (size == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			struct CacheEntry *grown = realloc(entries, capacity * sizeof(struct CacheEntry));
+			if (grown == NULL) { break; }
+			entries = grown;
+		}
+		strcpy(entries[size].name, dirEntry->d_name);
+		entries[size].mtime = st.st_mtim;
+		entries[size].size = st.st_size;
+		totalBytes += st.st_size;
+		size++;
+	}
+	qsort(entries, size, sizeof(struct CacheEntry), compareEntryAge);
+
+	long long target = cache->maxBytes / 100 * TRIM_PERCENT;
+	int i;
+	for (i = 0; i < size && totalBytes > target; i++) {
+		// ENOENT means another grader evicted it first
+		if (unlinkat(dirfd(dir), entries[i].name, 0) == SUCCESS || errno == ENOENT) {
+			totalBytes -= entries[i].size;
+		}
+	}
+	cache->totalBytes = totalBytes;
+
+	free(entries);
+	closedir(dir);
+	pthread_mutex_unlock(&cache->lock);
+	return SUCCESS;
+}
@@ -0,0 +1,60 @@
+#ifndef __CACHE__
+#define __CACHE__
+
+#include "common.h"
+#include "hash.h"
+#include <pthread.h>
+#include <sys/types.h>
+#include <dirent.h>
+
+// cache directory + key + extension
+#define MAX_CACHE_PATH   (MAX_PATH + SHA256_HEX_SIZE + 8)
+
+// default size cap of the cache (see '-S')
+#define DEFAULT_CACHE_MB (512)
+
+enum CacheStatus {
+	CACHE_MISS          = 0,
+	// the source compiled - the binary was copied to the requested file
+	CACHE_BINARY        = 1,
+	// the source didn't compile - gcc's messages were written to the log
+	CACHE_COMPILE_ERROR = 2,
+};
+
+// a content-addressed store of compiled binaries and compile errors
+// entries are named after the hash of everything that affects gcc's output:
+// the compiler's version, the flags, the source path and the bytes of the student's files
+// '<key>.bin' holds a binary and '<key>.err' holds the messages of a failed compile
+struct CompileCache {
+	// FALSE if the grader runs without a cache
+	int enabled;
+	char dirPath[MAX_PATH];
+	// the oldest entries are evicted once the cache grows beyond this size
+	long long maxBytes;
+	long long totalBytes;
+	// hash of 'gcc --version' and the flags - mixed into every key
+	unsigned char compilerDigest[SHA256_SIZE];
+	// protects totalBytes and eviction
+	pthread_mutex_t lock;
+};
+
+// hash the output of 'compiler --version' and the flags
+int hashCompiler(const char *compiler, char *const flags[], unsigned char digest[SHA256_SIZE]);
+
+int cacheInit(struct CompileCache *cache, const char *dirPath, long long maxBytes,
+              const char *compiler, char *const flags[]);
+void cacheDestroy(struct CompileCache *cache);
+
+// compute the key of a source file
+// the other files 'isSourceFile' picks in its directory are part of it (e.g. a local header)
+int cacheKey(struct CompileCache *cache, const char *codeFilePath,
+             int (*isSourceFile)(const struct dirent *), char key[SHA256_HEX_SIZE]);
+// look a key up - on a hit, the binary is written to 'fd_bin' or the messages are written to 'fd_log'
+enum CacheStatus cacheLookup(struct CompileCache *cache, const char *key, int fd_bin, int fd_log);
+// insert the result of a compilation
+// 'fd_bin' is ERROR if the compilation failed, and the messages are read from 'fd_log' starting at 'logStart'
+int cacheStore(struct CompileCache *cache, const char *key, int fd_bin, int fd_log, off_t logStart);
+// evict the least recently used entries until the cache is below its size cap
+int cacheTrim(struct CompileCache *cache);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __COMMON__
+#define __COMMON__
+
+#define TRUE      (1)
+#define FALSE     (0)
+
+#define SUCCESS   (0)
+#define ERROR     (-1)
+
+#define MAX_PATH  (150)
+
+// every program defines its own error printing functions
+void printError(const char *funcName);
+void printCustomError(const char *msg);
+
+#endif
@@ -0,0 +1,588 @@
+#include "compare.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_NORMALIZERS
+#endif
+
+// size of the chunks normalized at once by a stream
+#define NORM_CHUNK (4096)
+// size of the blocks the exact comparison reads at once
+#define CMP_BLOCK  (64 * 1024)
+
+static ssize_t readBlock(struct File *file, char *buf, size_t bytes, const char **block);
+
+// a simple wrapper for open
+int openFile(struct File *file, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == ERROR) {
+		printError("open");
+		return ERROR;
+	}
+
+	// initialize the file's fields
+	file->fd = fd;
+	file->map = NULL;
+	file->mapLen = 0;
+	file->mapPos = 0;
+
+	// map regular files, so comparing them takes no read calls at all
+	// (files that report no size, like the ones in /proc, are read)
+	struct stat st;
+	if (fstat(fd, &st) == SUCCESS && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			// both hints are only hints - nothing to do if they're refused
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+			madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+			file->map = map;
+			file->mapLen = st.st_size;
+		}
+	}
+
+	return SUCCESS;
+}
+
+int closeFile(struct File *file) {
+	if (file->map != NULL && munmap((void *)file->map, file->mapLen) == ERROR) {
+		printError("munmap");
+		close(file->fd);
+		return ERROR;
+	}
+	if (close(file->fd) == ERROR) {
+		printError("close");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+// the next 'bytes' bytes of the file (fewer only at its end) in '*block'
+// a mapped file's block points into the map, the others are read into 'buf'
+static ssize_t readBlock(struct File *file, char *buf, size_t bytes, const char **block) {
+	if (file->map != NULL) {
+		size_t count = file->mapLen - file->mapPos < bytes ? file->mapLen - file->mapPos : bytes;
+		*block = file->map + file->mapPos;
+		file->mapPos += count;
+		return count;
+	}
+	*block = buf;
+	size_t filled = 0;
+	while (filled < bytes) {
+		ssize_t ret = read(file->fd, buf + filled, bytes - filled);
+		if (ret == ERROR) {
+			printError("read");
+			return ERROR;
+		}
+		// no more data to read from the file
+		if (ret == 0) {
+			break;
+		}
+		filled += ret;
+	}
+	return filled;
+}
+
+enum ComparisonStatus getCmpStat(struct File *firstFile, struct File *secondFile) {
+	char *buf = malloc(2 * CMP_BLOCK);
+	if (buf == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	struct File *files[] = { firstFile, secondFile };
+	int ended[] = { FALSE, FALSE };
+	struct CmpPair pair;
+	cmpPairInit(&pair);
+
+	// a single pass over both files, so pipes can be compared too
+	// a block of each in turn, so neither gets far ahead (the pair buffers the difference)
+	int status = SUCCESS;
+	while (status == SUCCESS && !(ended[CMP_LEFT] && ended[CMP_RIGHT]) && !cmpPairDecided(&pair)) {
+		int side;
+		for (side = CMP_LEFT; side <= CMP_RIGHT && status == SUCCESS; side++) {
+			if (ended[side]) { continue; }
+			const char *block;
+			ssize_t len = readBlock(files[side], buf + side * CMP_BLOCK, CMP_BLOCK, &block);
+			if (len == ERROR) {
+				status = ERROR;
+			} else if (len == 0) {
+				ended[side] = TRUE;
+				cmpPairEnd(&pair, side);
+			} else {
+				cmpPairFeed(&pair, side, block, len);
+			}
+		}
+	}
+	enum ComparisonStatus verdict = cmpPairFinish(&pair);
+	free(buf);
+	return status == ERROR ? FILES_ERROR : verdict;
+}
+
+// the C locale's isspace and toupper (the grader never calls setlocale)
+static inline int isSpaceChar(unsigned char ch) {
+	return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+static inline unsigned char upperChar(unsigned char ch) {
+	return ch >= 'a' && ch <= 'z' ? ch - ('a' - 'A') : ch;
+}
+
+static size_t normalizeScalar(const char *src, size_t len, char *dest) {
+	size_t i, written = 0;
+	for (i = 0; i < len; i++) {
+		unsigned char ch = src[i];
+		if (!isSpaceChar(ch)) {
+			dest[written++] = upperChar(ch);
+		}
+	}
+	return written;
+}
+
+#ifdef X86_NORMALIZERS
+// the vector normalizers find the spaces and fold the case of a whole vector at once
+// (the comparisons are signed, so bytes over 127 are neither spaces nor lowercase)
+// each vector is loaded before anything is written, and nothing is written past its end,
+// so they work in place too
+
+__attribute__((target("sse2")))
+static size_t normalizeSse2(const char *src, size_t len, char *dest) {
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i beforeTab = _mm_set1_epi8('\t' - 1), afterReturn = _mm_set1_epi8('\r' + 1);
+	const __m128i beforeA = _mm_set1_epi8('a' - 1), afterZ = _mm_set1_epi8('z' + 1);
+	const __m128i caseBit = _mm_set1_epi8('a' - 'A');
+	size_t i = 0, written = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(chars, space),
+			_mm_and_si128(_mm_cmpgt_epi8(chars, beforeTab), _mm_cmplt_epi8(chars, afterReturn)));
+		__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(chars, beforeA), _mm_cmplt_epi8(chars, afterZ));
+		chars = _mm_sub_epi8(chars, _mm_and_si128(lower, caseBit));
+		unsigned keep = ~_mm_movemask_epi8(spaces) & 0xffff;
+		if (keep == 0xffff) {
+			_mm_storeu_si128((__m128i *)(dest + written), chars);
+			written += 16;
+		} else if (keep != 0) {
+			// SSE2 can't shuffle bytes - compact the kept ones one by one
+			char folded[16];
+			_mm_storeu_si128((__m128i *)folded, chars);
+			for (; keep != 0; keep &= keep - 1) {
+				dest[written++] = folded[__builtin_ctz(keep)];
+			}
+		}
+	}
+	return written + normalizeScalar(src + i, len - i, dest + written);
+}
+
+// for every 8-bit mask, the pshufb indices that move the bytes it keeps to the front
+static uint64_t compactShuffles[256];
+
+static void initCompactShuffles(void) {
+	int mask, bit;
+	for (mask = 0; mask < 256; mask++) {
+		uint64_t shuffle = 0;
+		int kept = 0;
+		for (bit = 0; bit < 8; bit++) {
+			if (mask & (1 << bit)) {
+				shuffle |= (uint64_t)bit << (8 * kept++);
+			}
+		}
+		compactShuffles[mask] = shuffle;
+	}
+}
+
+__attribute__((target("avx2")))
+static size_t normalizeAvx2(const char *src, size_t len, char *dest) {
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i beforeTab = _mm256_set1_epi8('\t' - 1), afterReturn = _mm256_set1_epi8('\r' + 1);
+	const __m256i beforeA = _mm256_set1_epi8('a' - 1), afterZ = _mm256_set1_epi8('z' + 1);
+	const __m256i caseBit = _mm256_set1_epi8('a' - 'A');
+	size_t i = 0, written = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i chars = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(chars, space),
+			_mm256_and_si256(_mm256_cmpgt_epi8(chars, beforeTab), _mm256_cmpgt_epi8(afterReturn, chars)));
+		__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, beforeA), _mm256_cmpgt_epi8(afterZ, chars));
+		chars = _mm256_sub_epi8(chars, _mm256_and_si256(lower, caseBit));
+		uint32_t keep = ~(uint32_t)_mm256_movemask_epi8(spaces);
+		if (keep == 0xffffffffu) {
+			_mm256_storeu_si256((__m256i *)(dest + written), chars);
+			written += 32;
+		} else if (keep != 0) {
+			// compact 8 bytes at a time with a shuffle (each store writes 8 bytes, but only
+			// the kept ones count - the rest is overwritten by the next store)
+			__m128i halves[2] = { _mm256_castsi256_si128(chars), _mm256_extracti128_si256(chars, 1) };
+			int part;
+			for (part = 0; part < 4; part++) {
+				unsigned mask = (keep >> (8 * part)) & 0xff;
+				__m128i bytes = part % 2 ? _mm_srli_si128(halves[part / 2], 8) : halves[part / 2];
+				__m128i shuffle = _mm_loadl_epi64((const __m128i *)&compactShuffles[mask]);
+				_mm_storel_epi64((__m128i *)(dest + written), _mm_shuffle_epi8(bytes, shuffle));
+				written += __builtin_popcount(mask);
+			}
+		}
+	}
+	return written + normalizeScalar(src + i, len - i, dest + written);
+}
+#endif
+
+static size_t (*const normalizers[NORMALIZERS])(const char *, size_t, char *) = {
+	[NORMALIZE_SCALAR] = normalizeScalar,
+#ifdef X86_NORMALIZERS
+	[NORMALIZE_SSE2] = normalizeSse2,
+	[NORMALIZE_AVX2] = normalizeAvx2,
+#endif
+};
+
+// the fastest normalizer the CPU supports - chosen before main, so the threads never race on it
+static size_t (*bestNormalizer)(const char *, size_t, char *) = normalizeScalar;
+
+int normalizerSupported(enum Normalizer which) {
+	switch (which) {
+	case NORMALIZE_SCALAR:
+		return TRUE;
+#ifdef X86_NORMALIZERS
+	case NORMALIZE_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case NORMALIZE_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+__attribute__((constructor))
+static void chooseNormalizer(void) {
+#ifdef X86_NORMALIZERS
+	// reads CPUID (constructors may run before libgcc's own initializes it)
+	__builtin_cpu_init();
+	initCompactShuffles();
+#endif
+	int which;
+	for (which = NORMALIZE_SCALAR; which < NORMALIZERS; which++) {
+		if (normalizerSupported(which)) {
+			bestNormalizer = normalizers[which];
+		}
+	}
+}
+
+size_t normalizeWith(enum Normalizer which, const char *src, size_t len, char *dest) {
+	return normalizers[which](src, len, dest);
+}
+
+size_t normalize(const char *src, size_t len, char *dest) {
+	return bestNormalizer(src, len, dest);
+}
+
+// read the whole reference file and compute its normalized form
+int cmpLoadReference(struct CmpReference *ref, const char *path) {
+	ref->raw = NULL;
+	ref->norm = NULL;
+	ref->rawLen = 0;
+	ref->normLen = 0;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == ERROR) {
+		printError("open");
+		return ERROR;
+	}
+	size_t capacity = BUF_SIZE;
+	int status = SUCCESS;
+	while (status == SUCCESS) {
+		// keep doubling the buffer until the whole file fits
+		if (ref->raw == NULL || ref->rawLen == capacity) {
+			capacity *= 2;
+			char *grown = realloc(ref->raw, capacity);
+			if (grown == NULL) {
+				printCustomError("Out of memory");
+				status = ERROR;
+				break;
+			}
+			ref->raw = grown;
+		}
+		ssize_t bytes = read(fd, ref->raw + ref->rawLen, capacity - ref->rawLen);
+		if (bytes == ERROR) {
+			printError("read");
+			status = ERROR;
+		} else if (bytes == 0) {
+			break;
+		} else {
+			ref->rawLen += bytes;
+		}
+	}
+	if (close(fd) == ERROR) {
+		printError("close");
+		status = ERROR;
+	}
+
+	if (status == SUCCESS) {
+		ref->norm = malloc(ref->rawLen + 1);
+		if (ref->norm == NULL) {
+			printCustomError("Out of memory");
+			status = ERROR;
+		} else {
+			ref->normLen = normalize(ref->raw, ref->rawLen, ref->norm);
+		}
+	}
+	if (status == ERROR) { cmpFreeReference(ref); }
+	return status;
+}
+
+void cmpFreeReference(struct CmpReference *ref) {
+	free(ref->raw);
+	free(ref->norm);
+	ref->raw = NULL;
+	ref->norm = NULL;
+}
+
+void cmpStreamInit(struct CmpStream *stream, const struct CmpReference *ref) {
+	stream->ref = ref;
+	stream->rawPos = 0;
+	stream->normPos = 0;
+	stream->identical = TRUE;
+	stream->similar = TRUE;
+}
+
+// match 'len' bytes against the reference at 'pos' (and advance it)
+// return FALSE on a mismatch or if the output is longer than the reference
+static int matchChunk(const char *ref, size_t refLen, size_t *pos, const char *buf, size_t len) {
+	if (len > refLen - *pos || memcmp(ref + *pos, buf, len) != 0) {
+		return FALSE;
+	}
+	*pos += len;
+	return TRUE;
+}
+
+void cmpStreamFeed(struct CmpStream *stream, const char *buf, size_t len) {
+	const struct CmpReference *ref = stream->ref;
+	if (stream->identical) {
+		stream->identical = matchChunk(ref->raw, ref->rawLen, &stream->rawPos, buf, len);
+	}
+	// normalize in small chunks, so we don't need a buffer as large as the input
+	char norm[NORM_CHUNK];
+	while (stream->similar && len > 0) {
+		size_t count = len < NORM_CHUNK ? len : NORM_CHUNK;
+		size_t normLen = normalize(buf, count, norm);
+		stream->similar = matchChunk(ref->norm, ref->normLen, &stream->normPos, norm, normLen);
+		buf += count;
+		len -= count;
+	}
+}
+
+int cmpStreamDecided(struct CmpStream *stream) {
+	// nothing can make the output similar again
+	return !stream->similar;
+}
+
+enum ComparisonStatus cmpStreamFinish(struct CmpStream *stream) {
+	const struct CmpReference *ref = stream->ref;
+	// a prefix of the reference isn't good enough
+	if (stream->identical && stream->rawPos == ref->rawLen) {
+		return FILES_IDENTICAL;
+	}
+	if (stream->similar && stream->normPos == ref->normLen) {
+		return FILES_SIMILAR;
+	}
+	return FILES_DIFFERENT;
+}
+
+static void lagInit(struct CmpLag *lag) {
+	lag->buf = NULL;
+	lag->start = 0;
+	lag->len = 0;
+	lag->capacity = 0;
+	lag->side = CMP_LEFT;
+}
+
+static void lagFree(struct CmpLag *lag) {
+	free(lag->buf);
+	lagInit(lag);
+}
+
+// keep 'len' bytes of 'side' until the other side gets to them
+static int lagAppend(struct CmpLag *lag, enum CmpSide side, const char *data, size_t len) {
+	if (len == 0) { return SUCCESS; }
+	lag->side = side;
+	if (lag->start + lag->len + len > lag->capacity) {
+		// move what's left to the front, and grow if that isn't enough
+		if (lag->len > 0) { memmove(lag->buf, lag->buf + lag->start, lag->len); }
+		lag->start = 0;
+		if (lag->len + len > lag->capacity) {
+			size_t capacity = lag->capacity ? lag->capacity : NORM_CHUNK;
+			while (capacity < lag->len + len) { capacity *= 2; }
+			char *grown = realloc(lag->buf, capacity);
+			if (grown == NULL) {
+				printCustomError("Out of memory");
+				return ERROR;
+			}
+			lag->buf = grown;
+			lag->capacity = capacity;
+		}
+	}
+	memcpy(lag->buf + lag->start + lag->len, data, len);
+	lag->len += len;
+	return SUCCESS;
+}
+
+// match 'len' bytes of 'side' against what the other side is ahead by, and keep whatever is left
+// returns FALSE on a mismatch ('*matched' bytes matched before it, and the lag starts at it)
+static int lagMatch(struct CmpLag *lag, enum CmpSide side, const char *data, size_t len, size_t *matched) {
+	*matched = 0;
+	if (lag->len > 0 && lag->side != side) {
+		size_t count = lag->len < len ? lag->len : len;
+		const char *ahead = lag->buf + lag->start;
+		if (memcmp(ahead, data, count) != 0) {
+			while (ahead[*matched] == data[*matched]) { (*matched)++; }
+		} else {
+			*matched = count;
+		}
+		lag->start += *matched;
+		lag->len -= *matched;
+		if (*matched < count) { return FALSE; }
+	}
+	return lagAppend(lag, side, data + *matched, len - *matched) == ERROR ? ERROR : TRUE;
+}
+
+void cmpPairInit(struct CmpPair *pair) {
+	pair->identical = TRUE;
+	pair->similar = TRUE;
+	pair->failed = FALSE;
+	pair->ended[CMP_LEFT] = FALSE;
+	pair->ended[CMP_RIGHT] = FALSE;
+	lagInit(&pair->raw);
+	lagInit(&pair->norm);
+}
+
+static void feedNormalized(struct CmpPair *pair, enum CmpSide side, const char *buf, size_t len) {
+	char norm[NORM_CHUNK];
+	while (pair->similar && !pair->failed && len > 0) {
+		size_t count = len < NORM_CHUNK ? len : NORM_CHUNK;
+		size_t normLen = normalize(buf, count, norm);
+		size_t matched;
+		int result = lagMatch(&pair->norm, side, norm, normLen, &matched);
+		if (result == ERROR) {
+			pair->failed = TRUE;
+		} else if (result == FALSE) {
+			pair->similar = FALSE;
+			lagFree(&pair->norm);
+		}
+		buf += count;
+		len -= count;
+	}
+}
+
+// the identical prefix is also identical once normalized (normalizing is done a character at a time),
+// so the similarity comparison starts where the exact one failed - with what one side was ahead by
+static void stopIdentical(struct CmpPair *pair) {
+	pair->identical = FALSE;
+	feedNormalized(pair, pair->raw.side, pair->raw.buf + pair->raw.start, pair->raw.len);
+	lagFree(&pair->raw);
+}
+
+// once a side ended, nothing can match what the other one is ahead by
+static void checkEnded(struct CmpPair *pair) {
+	if (pair->identical && pair->raw.len > 0 && pair->ended[!pair->raw.side]) {
+		stopIdentical(pair);
+	}
+	if (pair->similar && pair->norm.len > 0 && pair->ended[!pair->norm.side]) {
+		pair->similar = FALSE;
+		lagFree(&pair->norm);
+	}
+}
+
+void cmpPairFeed(struct CmpPair *pair, enum CmpSide side, const char *buf, size_t len) {
+	if (pair->failed) { return; }
+	if (pair->identical) {
+		size_t matched;
+		int result = lagMatch(&pair->raw, side, buf, len, &matched);
+		if (result == ERROR) {
+			pair->failed = TRUE;
+			return;
+		}
+		if (result == FALSE) {
+			stopIdentical(pair);
+			feedNormalized(pair, side, buf + matched, len - matched);
+		}
+	} else {
+		feedNormalized(pair, side, buf, len);
+	}
+	checkEnded(pair);
+}
+
+void cmpPairEnd(struct CmpPair *pair, enum CmpSide side) {
+	pair->ended[side] = TRUE;
+	checkEnded(pair);
+}
+
+int cmpPairDecided(struct CmpPair *pair) {
+	return pair->failed || (!pair->identical && !pair->similar);
+}
+
+enum ComparisonStatus cmpPairFinish(struct CmpPair *pair) {
+	cmpPairEnd(pair, CMP_LEFT);
+	cmpPairEnd(pair, CMP_RIGHT);
+	enum ComparisonStatus status;
+	if (pair->failed) {
+		status = FILES_ERROR;
+	} else if (pair->identical) {
+		status = FILES_IDENTICAL;
+	} else if (pair->similar) {
+		status = FILES_SIMILAR;
+	} else {
+		status = FILES_DIFFERENT;
+	}
+	lagFree(&pair->raw);
+	lagFree(&pair->norm);
+	return status;
+}
+
+enum ComparisonStatus cmpReferenceFile(const struct CmpReference *ref, const char *path) {
+	struct File file;
+	if (openFile(&file, path) == ERROR) {
+		return FILES_ERROR;
+	}
+	struct CmpStream stream;
+	cmpStreamInit(&stream, ref);
+	int status = SUCCESS;
+	if (file.map != NULL) {
+		// a file of another size can't be identical - only the similarity comparison is left
+		if (file.mapLen != ref->rawLen) {
+			stream.identical = FALSE;
+		}
+		// a block at a time, so a mismatch early on leaves the rest of the file untouched
+		size_t pos;
+		for (pos = 0; pos < file.mapLen && !cmpStreamDecided(&stream); pos += CMP_BLOCK) {
+			size_t count = file.mapLen - pos < CMP_BLOCK ? file.mapLen - pos : CMP_BLOCK;
+			cmpStreamFeed(&stream, file.map + pos, count);
+		}
+	} else {
+		char *buf = malloc(CMP_BLOCK);
+		if (buf == NULL) {
+			printCustomError("Out of memory");
+			status = ERROR;
+		}
+		while (status == SUCCESS && !cmpStreamDecided(&stream)) {
+			const char *block;
+			ssize_t len = readBlock(&file, buf, CMP_BLOCK, &block);
+			if (len == ERROR) {
+				status = ERROR;
+			} else if (len == 0) {
+				break;
+			} else {
+				cmpStreamFeed(&stream, block, len);
+			}
+		}
+		free(buf);
+	}
+	if (closeFile(&file) == ERROR || status == ERROR) {
+		return FILES_ERROR;
+	}
+	return cmpStreamFinish(&stream);
+}
@@ -0,0 +1,133 @@
+#ifndef __COMPARE__
+#define __COMPARE__
+
+#include "common.h"
+#include <stddef.h>
+
+#define BUF_SIZE  (512)
+
+// bump whenever a comparison may get a different verdict than before
+// (e.g. the grader's state file is keyed by it)
+#define COMPARE_VERSION (1)
+
+// compareFiles return value
+enum ComparisonStatus {
+	FILES_ERROR     = -1,
+	FILES_IDENTICAL = 1,
+	FILES_DIFFERENT = 2,
+	FILES_SIMILAR   = 3,
+};
+
+struct File {
+	// file descriptor
+	int fd;
+	// a regular file is mapped as a whole (NULL for pipes and special files - they're read)
+	const char *map;
+	size_t mapLen;
+	// read position in the map
+	size_t mapPos;
+};
+
+int openFile(struct File *file, const char *path);
+int closeFile(struct File *file);
+
+// check if two files are identical, similar or different
+enum ComparisonStatus getCmpStat(struct File *firstFile, struct File *secondFile);
+
+// the similarity mode ignores spaces and case
+// write the normalized form of 'len' bytes of 'src' into 'dest' (which must fit 'len' bytes,
+// and may be 'src' itself)
+// return the length of the normalized form
+size_t normalize(const char *src, size_t len, char *dest);
+
+// the implementations of 'normalize' - it uses the fastest one the CPU supports (CPUID)
+// they all give the same result (the C locale's isspace and toupper)
+enum Normalizer {
+	NORMALIZE_SCALAR,
+	NORMALIZE_SSE2,
+	NORMALIZE_AVX2,
+	NORMALIZERS,
+};
+
+int normalizerSupported(enum Normalizer which);
+size_t normalizeWith(enum Normalizer which, const char *src, size_t len, char *dest);
+
+// a file that many outputs are compared against
+// it's read (and normalized) once, and then shared by all of the streams
+struct CmpReference {
+	char *raw;
+	size_t rawLen;
+	char *norm;
+	size_t normLen;
+};
+
+int cmpLoadReference(struct CmpReference *ref, const char *path);
+void cmpFreeReference(struct CmpReference *ref);
+
+// compares an output to a reference while it's being produced (e.g. read from a pipe)
+// the exact and the similarity comparisons run side by side, so the output is read only once
+struct CmpStream {
+	const struct CmpReference *ref;
+	// how much of the reference was matched so far
+	size_t rawPos;
+	size_t normPos;
+	// cleared on the first mismatch
+	int identical;
+	int similar;
+};
+
+void cmpStreamInit(struct CmpStream *stream, const struct CmpReference *ref);
+// feed the next chunk of the output
+void cmpStreamFeed(struct CmpStream *stream, const char *buf, size_t len);
+// TRUE once the verdict can't change anymore (the rest of the output can be discarded)
+int cmpStreamDecided(struct CmpStream *stream);
+// the verdict, once the whole output was fed
+enum ComparisonStatus cmpStreamFinish(struct CmpStream *stream);
+
+// the two outputs a CmpPair compares
+enum CmpSide {
+	CMP_LEFT  = 0,
+	CMP_RIGHT = 1,
+};
+
+// bytes one side is ahead by (the other side didn't get to them yet)
+struct CmpLag {
+	char *buf;
+	size_t start;
+	size_t len;
+	size_t capacity;
+	enum CmpSide side;
+};
+
+// compares two outputs that are pushed in chunks of any size, from any source (files, pipes,
+// sockets, memory) - the same verdicts as getCmpStat, which is built on it
+// the sides may be fed in any order: whatever one is ahead by is kept until the other catches up,
+// so feeding them in turns keeps the memory small
+// the similarity comparison only starts at the first difference (on the rest of both outputs)
+struct CmpPair {
+	// cleared on the first mismatch
+	int identical;
+	int similar;
+	// TRUE if a buffer couldn't grow
+	int failed;
+	int ended[2];
+	// the raw bytes one side is ahead by (until they aren't identical)
+	struct CmpLag raw;
+	// the normalized bytes one side is ahead by (once they aren't identical)
+	struct CmpLag norm;
+};
+
+void cmpPairInit(struct CmpPair *pair);
+void cmpPairFeed(struct CmpPair *pair, enum CmpSide side, const char *buf, size_t len);
+// a side ended (optional - it only lets the pair stop buffering what the other side is ahead by)
+void cmpPairEnd(struct CmpPair *pair, enum CmpSide side);
+// TRUE once the verdict can't change anymore (the rest of both outputs can be discarded)
+int cmpPairDecided(struct CmpPair *pair);
+// the verdict, once both outputs were fed (FILES_ERROR if out of memory)
+// it frees the buffers, so it must be called even if the comparison is abandoned
+enum ComparisonStatus cmpPairFinish(struct CmpPair *pair);
+
+// compare a whole file to the reference (it's mapped if it's a regular file, so nothing is copied)
+enum ComparisonStatus cmpReferenceFile(const struct CmpReference *ref, const char *path);
+
+#endif
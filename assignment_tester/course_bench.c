@@ -0,0 +1,373 @@
+// generates a synthetic course and grades it - the yardstick for the grader's performance
+// usage: course_bench.out [-n students] [-m mix] [-d dir] [-g grader] [-- grader args]
+// the mix is a comma separated list of kind=weight, the kinds being
+// correct, similar, wrong, compile (error), timeout, flood (output limit) and noc (no .c file)
+// every student's code is a little different, so the compile cache can't grade them all at once
+#define _GNU_SOURCE
+
+#include "common.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <ftw.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_STUDENTS (200)
+#define DEFAULT_MIX      "correct=60,similar=10,wrong=10,compile=10,timeout=2,flood=3,noc=5"
+#define DEFAULT_DIR      "/tmp/course"
+#define DEFAULT_GRADER   "./a.out"
+
+// a directory is only ever deleted if it has this file (so '-d' can't wipe anything else)
+#define MARKER_FILE      ".course_bench"
+// the amount of numbers the programs sum up
+#define INPUT_NUMBERS    (1000)
+#define MAX_GRADER_ARGS  (64)
+// how often the grader's peak RSS is sampled
+#define SAMPLE_USEC      (20000)
+
+enum Kind {
+	KIND_CORRECT,
+	KIND_SIMILAR,
+	KIND_WRONG,
+	KIND_COMPILE,
+	KIND_TIMEOUT,
+	KIND_FLOOD,
+	KIND_NOC,
+	KIND_COUNT
+};
+
+static const char *const kindNames[KIND_COUNT] = {
+	"correct", "similar", "wrong", "compile", "timeout", "flood", "noc"
+};
+
+// the reason the grader should give every kind
+static const char *const kindReasons[KIND_COUNT] = {
+	"EXCELLENT", "SIMILAR", "WRONG", "COMPILATION_ERROR", "TIMEOUT", "OUTPUT_LIMIT", "NO_C_FILE"
+};
+
+// the program of every kind (but 'noc'), given the student's number
+// they all sum the numbers of the input
+static const char *const sources[KIND_COUNT] = {
+	[KIND_CORRECT] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tlong long n, x, sum = 0;\n\tif (scanf(\"%%lld\", &n) != 1) { return 1; }\n"
+		"\twhile (n-- > 0 && scanf(\"%%lld\", &x) == 1) { sum += x; }\n"
+		"\tprintf(\"sum = %%lld\\n\", sum);\n\treturn 0;\n}\n",
+	[KIND_SIMILAR] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tlong long n, x, sum = 0;\n\tif (scanf(\"%%lld\", &n) != 1) { return 1; }\n"
+		"\twhile (n-- > 0 && scanf(\"%%lld\", &x) == 1) { sum += x; }\n"
+		"\tprintf(\"SUM  =  %%lld\\n\\n\", sum);\n\treturn 0;\n}\n",
+	[KIND_WRONG] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tlong long n, x, sum = 0;\n\tif (scanf(\"%%lld\", &n) != 1) { return 1; }\n"
+		"\twhile (n-- > 1 && scanf(\"%%lld\", &x) == 1) { sum += x; }\n"
+		"\tprintf(\"sum = %%lld\\n\", sum);\n\treturn 0;\n}\n",
+	[KIND_COMPILE] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tlong long n, x, sum = 0\n\tprintf(\"sum = %%lld\\n\", sum);\n",
+	[KIND_TIMEOUT] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tvolatile long long sum = 0;\n\tfor (;;) { sum++; }\n\treturn 0;\n}\n",
+	[KIND_FLOOD] =
+		"// student %d\n#include <stdio.h>\n"
+		"int main(void) {\n\tfor (;;) { printf(\"sum = %%d\\n\", %d); }\n\treturn 0;\n}\n",
+};
+
+void printCustomError(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+}
+
+void printError(const char *funcName) {
+	perror(funcName);
+}
+
+static double getTimeSec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "kind=weight,..." - the kinds that aren't mentioned get 0
+static int parseMix(const char *spec, int weights[KIND_COUNT]) {
+	memset(weights, 0, KIND_COUNT * sizeof(int));
+	char *copy = strdup(spec);
+	if (copy == NULL) { return ERROR; }
+	int total = 0;
+	char *save, *item;
+	for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		char *eq = strchr(item, '=');
+		if (eq == NULL) { break; }
+		*eq = '\0';
+		int kind;
+		for (kind = 0; kind < KIND_COUNT && strcmp(kindNames[kind], item) != 0; kind++) {}
+		if (kind == KIND_COUNT || atoi(eq + 1) < 0) { break; }
+		weights[kind] = atoi(eq + 1);
+		total += weights[kind];
+	}
+	int complete = item == NULL;
+	free(copy);
+	return complete && total > 0 ? total : ERROR;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+// start from an empty directory (deleting a previous course, but nothing else)
+static int prepareDir(const char *dir) {
+	char marker[MAX_PATH * 2];
+	snprintf(marker, sizeof(marker), "%s/%s", dir, MARKER_FILE);
+	if (access(marker, F_OK) == SUCCESS) {
+		if (nftw(dir, removeEntry, 16, FTW_DEPTH | FTW_PHYS) == ERROR) {
+			printError("nftw");
+			return ERROR;
+		}
+	} else if (access(dir, F_OK) == SUCCESS) {
+		fprintf(stderr, "%s exists and isn't a generated course\n", dir);
+		return ERROR;
+	}
+	if (mkdir(dir, 0777) == ERROR) {
+		printError("mkdir");
+		return ERROR;
+	}
+	FILE *file = fopen(marker, "w");
+	if (file == NULL) {
+		printError("fopen");
+		return ERROR;
+	}
+	fclose(file);
+	return SUCCESS;
+}
+
+static int writeFile(const char *path, const char *content) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		printError("fopen");
+		return ERROR;
+	}
+	fputs(content, file);
+	return fclose(file) == EOF ? ERROR : SUCCESS;
+}
+
+// the config, the test case and the students (the kinds are drawn with a fixed seed)
+static int generateCourse(const char *dir, int students, const int weights[KIND_COUNT], int total,
+                          int counts[KIND_COUNT]) {
+	char path[MAX_PATH * 2], code[1024];
+	snprintf(path, sizeof(path), "%s/io", dir);
+	if (mkdir(path, 0777) == ERROR) {
+		printError("mkdir");
+		return ERROR;
+	}
+	snprintf(path, sizeof(path), "%s/io/input.txt", dir);
+	FILE *input = fopen(path, "w");
+	if (input == NULL) {
+		printError("fopen");
+		return ERROR;
+	}
+	srand(1);
+	long long sum = 0;
+	int i;
+	fprintf(input, "%d\n", INPUT_NUMBERS);
+	for (i = 0; i < INPUT_NUMBERS; i++) {
+		int number = rand() % 100000;
+		sum += number;
+		fprintf(input, "%d\n", number);
+	}
+	fclose(input);
+	snprintf(path, sizeof(path), "%s/io/correct_output.txt", dir);
+	snprintf(code, sizeof(code), "sum = %lld\n", sum);
+	if (writeFile(path, code) == ERROR) { return ERROR; }
+	snprintf(path, sizeof(path), "%s/conf.txt", dir);
+	if (writeFile(path, "students\nio/input.txt\nio/correct_output.txt\n") == ERROR) { return ERROR; }
+	snprintf(path, sizeof(path), "%s/students", dir);
+	if (mkdir(path, 0777) == ERROR) {
+		printError("mkdir");
+		return ERROR;
+	}
+
+	memset(counts, 0, KIND_COUNT * sizeof(int));
+	for (i = 0; i < students; i++) {
+		int pick = rand() % total;
+		int kind;
+		for (kind = 0; pick >= weights[kind]; kind++) {
+			pick -= weights[kind];
+		}
+		counts[kind]++;
+		snprintf(path, sizeof(path), "%s/students/student%05d", dir, i);
+		if (mkdir(path, 0777) == ERROR) {
+			printError("mkdir");
+			return ERROR;
+		}
+		if (kind == KIND_NOC) {
+			snprintf(path, sizeof(path), "%s/students/student%05d/notes.txt", dir, i);
+			snprintf(code, sizeof(code), "student %d forgot to submit\n", i);
+		} else {
+			snprintf(path, sizeof(path), "%s/students/student%05d/main.c", dir, i);
+			snprintf(code, sizeof(code), sources[kind], i, i);
+		}
+		if (writeFile(path, code) == ERROR) { return ERROR; }
+	}
+	return SUCCESS;
+}
+
+// the peak RSS of a running process (VmHWM, in KB) - 0 once it's gone
+static long readPeakRss(pid_t pid) {
+	char path[64], line[256];
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+	FILE *file = fopen(path, "r");
+	if (file == NULL) { return 0; }
+	long peak = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "VmHWM: %ld", &peak) == 1) { break; }
+	}
+	fclose(file);
+	return peak;
+}
+
+// count the reasons in results.csv and compare them to the kinds that were generated
+static int checkResults(const char *dir, const int counts[KIND_COUNT]) {
+	char path[MAX_PATH * 2], line[1024];
+	snprintf(path, sizeof(path), "%s/results.csv", dir);
+	FILE *results = fopen(path, "r");
+	if (results == NULL) {
+		printError("fopen");
+		return ERROR;
+	}
+	int found[KIND_COUNT] = { 0 };
+	int other = 0;
+	while (fgets(line, sizeof(line), results)) {
+		// name,grade,reason,...
+		char *reason = strchr(line, ',');
+		reason = reason != NULL ? strchr(reason + 1, ',') : NULL;
+		if (reason == NULL) { continue; }
+		reason++;
+		int kind;
+		for (kind = 0; kind < KIND_COUNT; kind++) {
+			size_t len = strlen(kindReasons[kind]);
+			if (strncmp(reason, kindReasons[kind], len) == 0 && reason[len] == ',') { break; }
+		}
+		if (kind < KIND_COUNT) {
+			found[kind]++;
+		} else {
+			other++;
+		}
+	}
+	fclose(results);
+
+	int status = other == 0 ? SUCCESS : ERROR;
+	int kind;
+	printf("%-10s %8s %8s\n", "kind", "expected", "graded");
+	for (kind = 0; kind < KIND_COUNT; kind++) {
+		printf("%-10s %8d %8d\n", kindNames[kind], counts[kind], found[kind]);
+		if (found[kind] != counts[kind]) { status = ERROR; }
+	}
+	if (other > 0) { printf("%-10s %8d %8d\n", "other", 0, other); }
+	return status;
+}
+
+int main(int argc, char *argv[]) {
+	int students = DEFAULT_STUDENTS;
+	const char *mix = DEFAULT_MIX;
+	const char *dir = DEFAULT_DIR;
+	const char *graderPath = DEFAULT_GRADER;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:m:d:g:")) != ERROR) {
+		switch (opt) {
+		case 'n':
+			students = atoi(optarg);
+			if (students <= 0) { return ERROR; }
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'g':
+			graderPath = optarg;
+			break;
+		default:
+			return ERROR;
+		}
+	}
+	int weights[KIND_COUNT];
+	int total = parseMix(mix, weights);
+	if (total == ERROR) {
+		printCustomError("Invalid mix");
+		return ERROR;
+	}
+	// the grader runs in the course's directory
+	char *grader = realpath(graderPath, NULL);
+	if (grader == NULL || strlen(dir) >= MAX_PATH) {
+		printCustomError("Can't find the grader");
+		return ERROR;
+	}
+
+	int counts[KIND_COUNT];
+	double start = getTimeSec();
+	if (prepareDir(dir) == ERROR || generateCourse(dir, students, weights, total, counts) == ERROR) {
+		free(grader);
+		return ERROR;
+	}
+	printf("generated %d students in %s (%.3f s)\n", students, dir, getTimeSec() - start);
+	fflush(stdout);
+
+	// the arguments after '--' go to the grader, and the profile is always on
+	char *graderArgv[MAX_GRADER_ARGS];
+	int graderArgc = 0;
+	graderArgv[graderArgc++] = grader;
+	while (optind < argc && graderArgc < MAX_GRADER_ARGS - 4) {
+		graderArgv[graderArgc++] = argv[optind++];
+	}
+	graderArgv[graderArgc++] = "-P";
+	graderArgv[graderArgc++] = "3";
+	graderArgv[graderArgc++] = "conf.txt";
+	graderArgv[graderArgc] = NULL;
+
+	start = getTimeSec();
+	pid_t pid = fork();
+	if (pid == ERROR) {
+		printError("fork");
+		free(grader);
+		return ERROR;
+	}
+	if (pid == 0) {
+		if (chdir(dir) == ERROR) { _exit(127); }
+		execv(grader, graderArgv);
+		_exit(127);
+	}
+	// sample the grader's own peak RSS while it runs (wait4's covers gcc and the programs too)
+	long peakRss = 0;
+	int status;
+	struct rusage usage;
+	pid_t waited;
+	while ((waited = wait4(pid, &status, WNOHANG, &usage)) == 0) {
+		long sample = readPeakRss(pid);
+		if (sample > peakRss) { peakRss = sample; }
+		usleep(SAMPLE_USEC);
+	}
+	double elapsed = getTimeSec() - start;
+	free(grader);
+	if (waited == ERROR) {
+		printError("wait4");
+		return ERROR;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != SUCCESS) {
+		printCustomError("The grader failed");
+		return ERROR;
+	}
+
+	printf("graded %d students in %.3f s: %.1f students/s\n", students, elapsed, students / elapsed);
+	printf("peak RSS: grader %ld KB, largest child %ld KB\n", peakRss, usage.ru_maxrss);
+	return checkResults(dir, counts);
+}
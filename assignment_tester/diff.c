@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+
+#include "diff.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum RunType {
+	RUN_EQUAL,
+	RUN_DELETE,
+	RUN_INSERT,
+};
+
+// consecutive lines the edit script keeps, deletes (from the first output) or inserts (from the second)
+struct Run {
+	enum RunType type;
+	int count;
+};
+
+// the lines of an output (each with its '\n', except maybe the last)
+struct Lines {
+	const char *text;
+	// line 'i' is text[starts[i]] ... text[starts[i + 1] - 1]
+	size_t *starts;
+	uint32_t *hashes;
+	int count;
+};
+
+// middleSnake's return value if the outputs have no line in common
+#define NO_SNAKE (1)
+
+struct Differ {
+	struct Lines first;
+	struct Lines second;
+	struct Run *runs;
+	int runCount;
+	int runCapacity;
+	int edits;
+	int maxEdits;
+};
+
+void findMismatch(const char *first, size_t firstLen, const char *second, size_t secondLen, struct Mismatch *mismatch) {
+	size_t len = firstLen < secondLen ? firstLen : secondLen;
+	size_t offset = 0;
+	// whole blocks first - the outputs are usually long and alike
+	while (offset + 4096 <= len && memcmp(first + offset, second + offset, 4096) == 0) {
+		offset += 4096;
+	}
+	while (offset < len && first[offset] == second[offset]) {
+		offset++;
+	}
+	mismatch->offset = offset;
+	mismatch->line = 1;
+	const char *lineStart = first;
+	const char *newline;
+	while ((newline = memchr(lineStart, '\n', first + offset - lineStart)) != NULL) {
+		mismatch->line++;
+		lineStart = newline + 1;
+	}
+	mismatch->column = first + offset - lineStart + 1;
+}
+
+// FNV-1a - a line is only compared byte by byte if the hashes are equal
+static uint32_t hashLine(const char *line, size_t len) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)line[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static int splitLines(struct Lines *lines, const char *text, size_t len) {
+	lines->text = text;
+	lines->count = 0;
+	size_t capacity = 1024;
+	lines->starts = malloc((capacity + 1) * sizeof(size_t));
+	lines->hashes = NULL;
+	if (lines->starts == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	size_t pos = 0;
+	while (pos < len) {
+		if ((size_t)lines->count == capacity) {
+			capacity *= 2;
+			size_t *grown = realloc(lines->starts, (capacity + 1) * sizeof(size_t));
+			if (grown == NULL) {
+				printCustomError("Out of memory");
+				return ERROR;
+			}
+			lines->starts = grown;
+		}
+		lines->starts[lines->count++] = pos;
+		const char *newline = memchr(text + pos, '\n', len - pos);
+		pos = newline != NULL ? (size_t)(newline - text) + 1 : len;
+	}
+	lines->starts[lines->count] = len;
+	lines->hashes = malloc((lines->count + 1) * sizeof(uint32_t));
+	if (lines->hashes == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	int i;
+	for (i = 0; i < lines->count; i++) {
+		lines->hashes[i] = hashLine(text + lines->starts[i], lines->starts[i + 1] - lines->starts[i]);
+	}
+	return SUCCESS;
+}
+
+static void freeLines(struct Lines *lines) {
+	free(lines->starts);
+	free(lines->hashes);
+}
+
+static int equalLines(const struct Differ *differ, int a, int b) {
+	const struct Lines *first = &differ->first, *second = &differ->second;
+	if (first->hashes[a] != second->hashes[b]) { return FALSE; }
+	size_t len = first->starts[a + 1] - first->starts[a];
+	return len == second->starts[b + 1] - second->starts[b] &&
+	       memcmp(first->text + first->starts[a], second->text + second->starts[b], len) == 0;
+}
+
+// append 'count' lines to the edit script (merged into the last run if it's of the same type)
+static int addRun(struct Differ *differ, enum RunType type, int count) {
+	if (count == 0) { return SUCCESS; }
+	if (type != RUN_EQUAL) {
+		differ->edits += count;
+		if (differ->edits > differ->maxEdits) { return DIFF_TOO_LONG; }
+	}
+	if (differ->runCount > 0 && differ->runs[differ->runCount - 1].type == type) {
+		differ->runs[differ->runCount - 1].count += count;
+		return SUCCESS;
+	}
+	if (differ->runCount == differ->runCapacity) {
+		int capacity = differ->runCapacity ? differ->runCapacity * 2 : 64;
+		struct Run *grown = realloc(differ->runs, capacity * sizeof(struct Run));
+		if (grown == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		differ->runs = grown;
+		differ->runCapacity = capacity;
+	}
+	differ->runs[differ->runCount].type = type;
+	differ->runs[differ->runCount++].count = count;
+	return SUCCESS;
+}
+
+// find the middle snake of first[aLo, aHi) and second[bLo, bHi) (both non-empty, and their first
+// and last lines differ) - the forward and the backward search advance a step in turns until
+// their furthest paths overlap, which splits the problem into two halves of about half the edits
+// 'maxD' steps of each are at most 2 * 'maxD' edits
+static int middleSnake(struct Differ *differ, int aLo, int aHi, int bLo, int bHi, int maxD, int *splitA, int *splitB) {
+	int n = aHi - aLo, m = bHi - bLo;
+	int fullD = (n + m + 1) / 2;
+	if (maxD > fullD) { maxD = fullD; }
+	// the furthest x (counted from the start, or from the end going backward) on every diagonal
+	int size = 2 * maxD + 2;
+	int *forward = malloc(2 * size * sizeof(int));
+	if (forward == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	int *backward = forward + size;
+	int i;
+	for (i = 0; i < size; i++) {
+		forward[i] = backward[i] = ERROR;
+	}
+	int offset = maxD;
+	forward[offset + 1] = backward[offset + 1] = 0;
+	int delta = n - m;
+	// with an odd delta the paths meet on a forward step, and otherwise on a backward one
+	int front = delta % 2 != 0;
+	// the diagonals that ran off the edges are skipped from then on
+	int forwardStart = 0, forwardEnd = 0, backwardStart = 0, backwardEnd = 0;
+	int d, k;
+	for (d = 0; d < maxD; d++) {
+		for (k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+			int index = offset + k;
+			int x = k == -d || (k != d && forward[index - 1] < forward[index + 1]) ?
+			        forward[index + 1] : forward[index - 1] + 1;
+			int y = x - k;
+			while (x < n && y < m && equalLines(differ, aLo + x, bLo + y)) {
+				x++;
+				y++;
+			}
+			forward[index] = x;
+			if (x > n) {
+				forwardEnd += 2;
+			} else if (y > m) {
+				forwardStart += 2;
+			} else if (front) {
+				int other = offset + delta - k;
+				if (other >= 0 && other < size && backward[other] != ERROR && x >= n - backward[other]) {
+					*splitA = aLo + x;
+					*splitB = bLo + y;
+					free(forward);
+					return SUCCESS;
+				}
+			}
+		}
+		for (k = -d + backwardStart; k <= d - backwardEnd; k += 2) {
+			int index = offset + k;
+			int x = k == -d || (k != d && backward[index - 1] < backward[index + 1]) ?
+			        backward[index + 1] : backward[index - 1] + 1;
+			int y = x - k;
+			while (x < n && y < m && equalLines(differ, aHi - x - 1, bHi - y - 1)) {
+				x++;
+				y++;
+			}
+			backward[index] = x;
+			if (x > n) {
+				backwardEnd += 2;
+			} else if (y > m) {
+				backwardStart += 2;
+			} else if (!front) {
+				int other = offset + delta - k;
+				if (other >= 0 && other < size && forward[other] != ERROR) {
+					int forwardX = forward[other];
+					int forwardY = offset + forwardX - other;
+					if (forwardX >= n - x) {
+						*splitA = aLo + forwardX;
+						*splitB = bLo + forwardY;
+						free(forward);
+						return SUCCESS;
+					}
+				}
+			}
+		}
+	}
+	free(forward);
+	// either nothing in common, or more edits than we're willing to look for
+	return maxD == fullD ? NO_SNAKE : DIFF_TOO_LONG;
+}
+
+// the edit script of first[aLo, aHi) and second[bLo, bHi), appended to the runs
+static int diffRange(struct Differ *differ, int aLo, int aHi, int bLo, int bHi) {
+	int status;
+	// the common prefix and suffix need no search
+	int prefix = 0;
+	while (aLo + prefix < aHi && bLo + prefix < bHi && equalLines(differ, aLo + prefix, bLo + prefix)) {
+		prefix++;
+	}
+	if ((status = addRun(differ, RUN_EQUAL, prefix)) != SUCCESS) { return status; }
+	aLo += prefix;
+	bLo += prefix;
+	int suffix = 0;
+	while (aLo < aHi - suffix && bLo < bHi - suffix && equalLines(differ, aHi - suffix - 1, bHi - suffix - 1)) {
+		suffix++;
+	}
+	aHi -= suffix;
+	bHi -= suffix;
+
+	if (aLo == aHi || bLo == bHi) {
+		if ((status = addRun(differ, RUN_DELETE, aHi - aLo)) != SUCCESS ||
+		    (status = addRun(differ, RUN_INSERT, bHi - bLo)) != SUCCESS) {
+			return status;
+		}
+	} else {
+		// each step of the search is up to two edits
+		int maxD = (differ->maxEdits - differ->edits) / 2 + 2;
+		int splitA, splitB;
+		status = middleSnake(differ, aLo, aHi, bLo, bHi, maxD, &splitA, &splitB);
+		if (status == NO_SNAKE) {
+			if ((status = addRun(differ, RUN_DELETE, aHi - aLo)) != SUCCESS ||
+			    (status = addRun(differ, RUN_INSERT, bHi - bLo)) != SUCCESS) {
+				return status;
+			}
+		} else if (status != SUCCESS ||
+		           (status = diffRange(differ, aLo, splitA, bLo, splitB)) != SUCCESS ||
+		           (status = diffRange(differ, splitA, aHi, splitB, bHi)) != SUCCESS) {
+			return status;
+		}
+	}
+	return addRun(differ, RUN_EQUAL, suffix);
+}
+
+static void printLines(FILE *out, char prefix, const struct Lines *lines, int from, int to) {
+	int i;
+	for (i = from; i < to; i++) {
+		size_t len = lines->starts[i + 1] - lines->starts[i];
+		const char *line = lines->text + lines->starts[i];
+		fputc(prefix, out);
+		fwrite(line, 1, len, out);
+		if (len == 0 || line[len - 1] != '\n') {
+			fputs("\n\\ No newline at end of file\n", out);
+		}
+	}
+}
+
+// a hunk's range, like diff prints it (an empty range starts at the line before it)
+static void printRange(FILE *out, size_t start, int count) {
+	if (count == 1) {
+		fprintf(out, "%zu", start + 1);
+	} else {
+		fprintf(out, "%zu,%d", count == 0 ? start : start + 1, count);
+	}
+}
+
+// a change - the lines some consecutive delete and insert runs replace
+struct Change {
+	int aStart;
+	int aEnd;
+	int bStart;
+	int bEnd;
+};
+
+static void printHunks(FILE *out, const struct Differ *differ, size_t lineBase) {
+	// turn the runs into changes
+	struct Change *changes = malloc((differ->runCount + 1) * sizeof(struct Change));
+	if (changes == NULL) {
+		printCustomError("Out of memory");
+		return;
+	}
+	int changeCount = 0;
+	int a = 0, b = 0, i;
+	for (i = 0; i < differ->runCount; i++) {
+		const struct Run *run = &differ->runs[i];
+		if (run->type == RUN_EQUAL) {
+			a += run->count;
+			b += run->count;
+			continue;
+		}
+		if (i == 0 || differ->runs[i - 1].type == RUN_EQUAL) {
+			changes[changeCount].aStart = changes[changeCount].aEnd = a;
+			changes[changeCount].bStart = changes[changeCount].bEnd = b;
+			changeCount++;
+		}
+		if (run->type == RUN_DELETE) {
+			a += run->count;
+			changes[changeCount - 1].aEnd = a;
+		} else {
+			b += run->count;
+			changes[changeCount - 1].bEnd = b;
+		}
+	}
+
+	// changes closer than twice the context share a hunk
+	int first = 0;
+	while (first < changeCount) {
+		int last = first;
+		while (last + 1 < changeCount && changes[last + 1].aStart - changes[last].aEnd <= 2 * DIFF_CONTEXT) {
+			last++;
+		}
+		int before = changes[first].aStart < DIFF_CONTEXT ? changes[first].aStart : DIFF_CONTEXT;
+		int after = differ->first.count - changes[last].aEnd;
+		if (after > DIFF_CONTEXT) { after = DIFF_CONTEXT; }
+		int aLo = changes[first].aStart - before, aHi = changes[last].aEnd + after;
+		int bLo = changes[first].bStart - before, bHi = changes[last].bEnd + after;
+		fputs("@@ -", out);
+		printRange(out, lineBase + aLo, aHi - aLo);
+		fputs(" +", out);
+		printRange(out, lineBase + bLo, bHi - bLo);
+		fputs(" @@\n", out);
+		int pos = aLo;
+		for (i = first; i <= last; i++) {
+			printLines(out, ' ', &differ->first, pos, changes[i].aStart);
+			printLines(out, '-', &differ->first, changes[i].aStart, changes[i].aEnd);
+			printLines(out, '+', &differ->second, changes[i].bStart, changes[i].bEnd);
+			pos = changes[i].aEnd;
+		}
+		printLines(out, ' ', &differ->first, pos, aHi);
+		first = last + 1;
+	}
+	free(changes);
+}
+
+int printDiff(FILE *out, const char *firstName, const char *first, size_t firstLen,
+              const char *secondName, const char *second, size_t secondLen, int maxEdits) {
+	// the lines before the first difference are the same - only the few printed as its context are split
+	struct Mismatch mismatch;
+	findMismatch(first, firstLen, second, secondLen, &mismatch);
+	size_t start = mismatch.offset - (mismatch.column - 1);
+	size_t lineBase = mismatch.line - 1;
+	int context;
+	for (context = 0; context < DIFF_CONTEXT && start > 0; context++) {
+		const char *newline = memrchr(first, '\n', start - 1);
+		start = newline != NULL ? (size_t)(newline - first) + 1 : 0;
+		lineBase--;
+	}
+
+	struct Differ differ;
+	memset(&differ, 0, sizeof(differ));
+	differ.maxEdits = maxEdits;
+	int status = splitLines(&differ.first, first + start, firstLen - start);
+	if (status == SUCCESS) {
+		status = splitLines(&differ.second, second + start, secondLen - start);
+	}
+	if (status == SUCCESS) {
+		status = diffRange(&differ, 0, differ.first.count, 0, differ.second.count);
+	}
+	if (status == SUCCESS) {
+		fprintf(out, "--- %s\n+++ %s\n", firstName, secondName);
+		printHunks(out, &differ, lineBase);
+		status = differ.edits;
+	}
+	freeLines(&differ.first);
+	freeLines(&differ.second);
+	free(differ.runs);
+	return status;
+}
@@ -0,0 +1,34 @@
+#ifndef __DIFF__
+#define __DIFF__
+
+#include "common.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// a diff needing more line edits than this isn't printed (see '-e')
+#define DEFAULT_MAX_EDITS (1000)
+// the unchanged lines printed around every change
+#define DIFF_CONTEXT      (3)
+
+// printDiff's return value if the files need more than 'maxEdits' edits
+#define DIFF_TOO_LONG     (-2)
+
+// where two outputs start to differ (the line and the column count from 1, the column in bytes)
+// if one of them is a prefix of the other, it's where the shorter one ends
+struct Mismatch {
+	size_t offset;
+	size_t line;
+	size_t column;
+};
+
+void findMismatch(const char *first, size_t firstLen, const char *second, size_t secondLen, struct Mismatch *mismatch);
+
+// print a unified diff of the lines of two outputs (which aren't identical) to 'out'
+// it's Myers' O(ND) algorithm in linear space (the middle snake, recursively), which gives up once
+// the edit distance is over 'maxEdits' - so two large, unrelated files cost O(N * maxEdits) time
+// and O(maxEdits) memory on top of the lines
+// returns the amount of line edits, DIFF_TOO_LONG (nothing is printed then) or ERROR
+int printDiff(FILE *out, const char *firstName, const char *first, size_t firstLen,
+              const char *secondName, const char *second, size_t secondLen, int maxEdits);
+
+#endif
@@ -1,52 +1,48 @@
-#include <ctype.h>
-#include <stdio.h>
-#include <sys/stat.h>
+#include "compare.h"
+#include "similarity.h"
+#include "diff.h"
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 
-#define TRUE      (1)
-#define FALSE     (0)
-
-#define SUCCESS   (0)
-#define ERROR     (-1)
-
-#define BUF_SIZE  (512)
 #define FD_STDOUT (1)
 
-// compareFiles return value
-enum ComparisonStatus {
-	FILES_ERROR     = -1,
-	FILES_IDENTICAL = 1,
-	FILES_DIFFERENT = 2,
-	FILES_SIMILAR   = 3,
-};
-
-struct File {
-	// file descriptor
-	int fd;
-	// read position in the buffer
-	int pos;
-	// amount of bytes read into the buffer
-	int size;
-	char buf[BUF_SIZE];
-};
-
-void printCustomError(const char *msg);
-void printError(const char *funcName);
-
-int openFile(struct File *file, const char *path);
-int resetFilePosition(struct File *file);
-int closeFile(struct File *file);
-int readFile(struct File *file, char *buf, int bytes);
+// pairs less similar than this aren't reported (see '-t')
+#define DEFAULT_THRESHOLD (0.5)
+// the report mode feeds the comparison this much of each file in turn
+#define FEED_CHUNK        (64 * 1024)
 
-char getNextChar(struct File *file);
-char skipSpace(struct File *file);
-
-int compareFiles(struct File *firstFile, struct File *secondFile, int similar);
-enum ComparisonStatus getCmpStat(struct File *firstFile, struct File *secondFile);
+int findSimilarFiles(int argc, char *argv[]);
+int compareToReference(int argc, char *argv[]);
+int reportDifference(int argc, char *argv[]);
+int scoreSimilarity(int argc, char *argv[]);
 
+// usage: comp.out <first file> <second file>
+//        comp.out -b [-k shingle] [-t threshold] <files...>
+//        comp.out -r <reference> [-j threads] <files...>
+//        comp.out -d [-e max edits] <first file> <second file>
+//        comp.out -s [-m minimum] <first file> <second file>
+// the first form returns 1 (identical), 2 (different) or 3 (similar)
+// the second one prints the pairs of files that look alike (e.g. copied submissions)
+// the third one prints that verdict for every file, compared to the same reference
+// the fourth one returns it too, and prints where the files differ and a unified diff
+// the fifth one prints how alike the files' tokens are, from 0 to 1 (for partial credit)
 int main(int argc, char *argv[]) {
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		return findSimilarFiles(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+		return compareToReference(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+		return reportDifference(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+		return scoreSimilarity(argc, argv);
+	}
 	if (argc < 3) {
 		// not enough arguments
 		return ERROR;
@@ -85,154 +81,273 @@ int main(int argc, char *argv[]) {
 	return status;
 }
 
-void printCustomError(const char *msg) {
-	char buf[BUF_SIZE] = { 0 };
-	strcat(buf, msg);
-	strcat(buf, "\n");
-	if (write(FD_STDOUT, buf, strlen(buf)) == ERROR) {}
-}
-
-void printError(const char *funcName) {
-	char buf[BUF_SIZE] = { 0 };
-	strcat(buf, "Error in: ");
-	strcat(buf, funcName);
-	printCustomError(buf);
-}
+// batch mode: sign every file (its normalized k-shingles, like the similarity mode normalizes it)
+// and print "similarity<TAB>first<TAB>second" for the pairs LSH finds, most similar first
+int findSimilarFiles(int argc, char *argv[]) {
+	int shingle = DEFAULT_SHINGLE;
+	double threshold = DEFAULT_THRESHOLD;
+	int opt;
+	// skip '-b'
+	optind = 2;
+	while ((opt = getopt(argc, argv, "k:t:")) != ERROR) {
+		switch (opt) {
+		case 'k':
+			shingle = atoi(optarg);
+			if (shingle <= 0) { return ERROR; }
+			break;
+		case 't':
+			threshold = atof(optarg);
+			if (threshold < 0 || threshold > 1) { return ERROR; }
+			break;
+		default:
+			return ERROR;
+		}
+	}
+	int count = argc - optind;
+	char **paths = argv + optind;
 
-// a simple wrapper for open
-int openFile(struct File *file, const char *path) {
-	int fd = open(path, O_RDONLY);
-	if (fd == ERROR) {
-		printError("open");
+	struct Signature *sigs = malloc((count + 1) * sizeof(struct Signature));
+	if (sigs == NULL) {
+		printCustomError("Out of memory");
 		return ERROR;
 	}
+	int i;
+	for (i = 0; i < count; i++) {
+		// a file we can't read is similar to nothing
+		if (signatureFile(&sigs[i], paths[i], shingle) == ERROR) { sigs[i].empty = TRUE; }
+	}
 
-	// initialize the file's fields
-	file->fd = fd;
-	file->size = 0;
-	file->pos = 0;
-	
-	return SUCCESS;
-}
-
-// a simple wrapper for lseek
-int resetFilePosition(struct File *file) {
-	// move the offset to the beginning of the file
-	if (lseek(file->fd, 0, SEEK_SET) == ERROR) {
-		printError("lseek");
-		return ERROR;
+	struct SimilarPair *pairs;
+	int pairCount = findSimilarPairs(sigs, count, threshold, &pairs);
+	for (i = 0; i < pairCount; i++) {
+		printf("%.3f\t%s\t%s\n", pairs[i].similarity, paths[pairs[i].first], paths[pairs[i].second]);
 	}
-	file->size = 0;
-	file->pos = 0;
-	return SUCCESS;
+	free(pairs);
+	free(sigs);
+	return pairCount == ERROR ? ERROR : SUCCESS;
 }
 
-int closeFile(struct File *file) {
-	if (close(file->fd) == ERROR) {
-		printError("close");
-		return ERROR;
+// the files '-r' compares, shared by its threads
+struct ReferenceBatch {
+	struct CmpReference ref;
+	char **paths;
+	int count;
+	// the next file a thread takes
+	int next;
+	enum ComparisonStatus *verdicts;
+};
+
+static void *compareBatchThread(void *arg) {
+	struct ReferenceBatch *batch = arg;
+	int i;
+	while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+		batch->verdicts[i] = cmpReferenceFile(&batch->ref, batch->paths[i]);
 	}
-	return SUCCESS;
+	return NULL;
 }
 
-// this function is similar to what we've seen in the recitation
-// fill 'buf' with the file's data
-int readFile(struct File *file, char *buf, int bytes) {
-	int i = 0;
-	for (i = 0; i < bytes; i++) {
-		// if we've read all the data in the buffer
-		if (file->pos == file->size) {
-			// reset the position and read new data from the file
-			file->pos = 0;
-			file->size = read(file->fd, file->buf, BUF_SIZE);
-			if (file->size == ERROR) {
-				printError("read");
-				return ERROR;
-			}
-			// no more data to read from the file - simply return i
-			if (file->size == 0) {
-				return i;
-			}
+// batch mode: the reference is read and normalized once, and the files are compared to it in parallel
+// prints "verdict<TAB>file" in the order of the arguments (the verdict being the first form's
+// return value, or -1 if the file couldn't be read)
+int compareToReference(int argc, char *argv[]) {
+	if (argc < 3) { return ERROR; }
+	const char *refPath = argv[2];
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	// skip '-r reference'
+	optind = 3;
+	while ((opt = getopt(argc, argv, "j:")) != ERROR) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) { return ERROR; }
+			break;
+		default:
+			return ERROR;
 		}
+	}
 
-		// fill buf with the file's data
-		buf[i] = file->buf[file->pos];
-		file->pos++;
+	struct ReferenceBatch batch;
+	batch.paths = argv + optind;
+	batch.count = argc - optind;
+	batch.next = 0;
+	if (cmpLoadReference(&batch.ref, refPath) == ERROR) { return ERROR; }
+	batch.verdicts = malloc((batch.count + 1) * sizeof(enum ComparisonStatus));
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	if (batch.verdicts == NULL || tids == NULL) {
+		printCustomError("Out of memory");
+		free(batch.verdicts);
+		free(tids);
+		cmpFreeReference(&batch.ref);
+		return ERROR;
 	}
+	if (threads > batch.count) { threads = batch.count; }
 
-	// return the amount of bytes we've read
-	return i;
-}
+	// this thread compares too, so a failed pthread_create only costs parallelism
+	int started = 0;
+	while (started < threads - 1 && pthread_create(&tids[started], NULL, compareBatchThread, &batch) == SUCCESS) {
+		started++;
+	}
+	compareBatchThread(&batch);
+	int i;
+	for (i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+	}
 
-// simple wrapper for readFile
-char getNextChar(struct File *file) {
-	char ch;
-	int ret = readFile(file, &ch, 1);
-	if (ret == ERROR || ret == 0) {
-		return ret;
+	for (i = 0; i < batch.count; i++) {
+		printf("%d\t%s\n", batch.verdicts[i], batch.paths[i]);
 	}
-	return ch;
+	free(batch.verdicts);
+	free(tids);
+	cmpFreeReference(&batch.ref);
+	return SUCCESS;
 }
 
-// return the first character that is not a space
-char skipSpace(struct File *file) {
-	char ch;
-	do {
-		// keep reading the next char as long as we're reading spaces
-		ch = getNextChar(file);
-		if (ch == ERROR || ch == 0) {
-			return ch;
+// read a whole file (a pipe too) into memory
+static char *readWholeFile(const char *path, size_t *len) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == ERROR) {
+		printError("open");
+		return NULL;
+	}
+	size_t capacity = FEED_CHUNK;
+	char *buf = malloc(capacity);
+	*len = 0;
+	while (buf != NULL) {
+		if (*len == capacity) {
+			capacity *= 2;
+			char *grown = realloc(buf, capacity);
+			if (grown == NULL) {
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = grown;
 		}
-	} while (isspace(ch));
-
-	return ch;
+		ssize_t bytes = read(fd, buf + *len, capacity - *len);
+		if (bytes == ERROR) {
+			printError("read");
+			free(buf);
+			close(fd);
+			return NULL;
+		}
+		if (bytes == 0) { break; }
+		*len += bytes;
+	}
+	if (buf == NULL) { printCustomError("Out of memory"); }
+	close(fd);
+	return buf;
 }
 
-int compareFiles(struct File *firstFile, struct File *secondFile, int similar) {
-	char firstCh, secondCh;
-	while (TRUE) {
-		// read the next character
-		// if we're only checking similarity - ignore spaces and case
-		firstCh = similar ? toupper(skipSpace(firstFile)) : getNextChar(firstFile);
-		secondCh = similar ? toupper(skipSpace(secondFile)) : getNextChar(secondFile);
-		if (firstCh == ERROR || secondCh == ERROR) {
-			return ERROR;
-		}
-		// we reached the end of one of the files
-		// or found two different characters
-		if (firstCh == 0 || secondCh == 0 || firstCh != secondCh) {
+// report mode: the same verdict, and for files that aren't identical, where they start to
+// differ and a unified diff (unless it takes more than '-e' line edits)
+int reportDifference(int argc, char *argv[]) {
+	int maxEdits = DEFAULT_MAX_EDITS;
+	int opt;
+	// skip '-d'
+	optind = 2;
+	while ((opt = getopt(argc, argv, "e:")) != ERROR) {
+		switch (opt) {
+		case 'e':
+			maxEdits = atoi(optarg);
+			if (maxEdits <= 0) { return ERROR; }
 			break;
+		default:
+			return ERROR;
 		}
 	}
-	// would return true if we reached the end of both files
-	return firstCh == secondCh;
-}
+	if (argc - optind != 2) { return ERROR; }
+	const char *paths[] = { argv[optind], argv[optind + 1] };
 
-enum ComparisonStatus getCmpStat(struct File *firstFile, struct File *secondFile) {
-	// check if files are completely identical
-	int identical = compareFiles(firstFile, secondFile, FALSE);
-	if (identical == ERROR) {
+	size_t lens[2];
+	char *texts[2];
+	texts[0] = readWholeFile(paths[0], &lens[0]);
+	texts[1] = texts[0] != NULL ? readWholeFile(paths[1], &lens[1]) : NULL;
+	if (texts[1] == NULL) {
+		free(texts[0]);
 		return ERROR;
 	}
-	if (identical == TRUE) {
-		return FILES_IDENTICAL;
+
+	// a chunk of each in turn, so the pair doesn't have to keep much
+	struct CmpPair pair;
+	cmpPairInit(&pair);
+	size_t pos;
+	int side;
+	for (pos = 0; (pos < lens[0] || pos < lens[1]) && !cmpPairDecided(&pair); pos += FEED_CHUNK) {
+		for (side = CMP_LEFT; side <= CMP_RIGHT; side++) {
+			if (pos < lens[side]) {
+				size_t count = lens[side] - pos < FEED_CHUNK ? lens[side] - pos : FEED_CHUNK;
+				cmpPairFeed(&pair, side, texts[side] + pos, count);
+			}
+		}
 	}
+	enum ComparisonStatus status = cmpPairFinish(&pair);
 
-	// reset the files (using lseek)
-	if (resetFilePosition(firstFile) == ERROR || 
-		resetFilePosition(secondFile) == ERROR) {
-		return ERROR;
+	if (status == FILES_DIFFERENT || status == FILES_SIMILAR) {
+		struct Mismatch mismatch;
+		findMismatch(texts[0], lens[0], texts[1], lens[1], &mismatch);
+		printf("first difference at byte %zu (line %zu, column %zu)", mismatch.offset, mismatch.line, mismatch.column);
+		if (mismatch.offset == lens[0] || mismatch.offset == lens[1]) {
+			printf(" - %s ends there", paths[mismatch.offset == lens[0] ? 0 : 1]);
+		}
+		printf("\n");
+		int edits = printDiff(stdout, paths[0], texts[0], lens[0], paths[1], texts[1], lens[1], maxEdits);
+		if (edits == DIFF_TOO_LONG) {
+			printf("more than %d lines differ - no diff\n", maxEdits);
+		} else if (edits == ERROR) {
+			status = FILES_ERROR;
+		}
 	}
+	free(texts[0]);
+	free(texts[1]);
+	return status;
+}
 
-	// check if files are similar
-	int similar = compareFiles(firstFile, secondFile, TRUE);
-	if (similar == ERROR) {
-		return ERROR;
+// score mode: print the token similarity ratio (see 'tokenSimilarity')
+// with '-m', ratios under the minimum aren't computed (the band is narrower, so it's faster) -
+// "below <minimum>" is printed instead
+int scoreSimilarity(int argc, char *argv[]) {
+	double minimum = 0;
+	int opt;
+	// skip '-s'
+	optind = 2;
+	while ((opt = getopt(argc, argv, "m:")) != ERROR) {
+		switch (opt) {
+		case 'm':
+			minimum = atof(optarg);
+			if (minimum < 0 || minimum > 1) { return ERROR; }
+			break;
+		default:
+			return ERROR;
+		}
 	}
-	if (similar == TRUE) {
-		return FILES_SIMILAR;
+	if (argc - optind != 2) { return ERROR; }
+
+	size_t firstLen, secondLen;
+	char *first = readWholeFile(argv[optind], &firstLen);
+	char *second = first != NULL ? readWholeFile(argv[optind + 1], &secondLen) : NULL;
+	double ratio = second != NULL ? tokenSimilarity(first, firstLen, second, secondLen, minimum) : ERROR;
+	free(first);
+	free(second);
+	if (ratio == ERROR) { return ERROR; }
+	if (ratio < minimum) {
+		printf("below %.3f\n", minimum);
+	} else {
+		printf("%.4f\n", ratio);
 	}
+	return SUCCESS;
+}
 
-	// files aren't identical or even similar
-	return FILES_DIFFERENT;
+void printCustomError(const char *msg) {
+	char buf[BUF_SIZE] = { 0 };
+	strcat(buf, msg);
+	strcat(buf, "\n");
+	if (write(FD_STDOUT, buf, strlen(buf)) == ERROR) {}
+}
+
+void printError(const char *funcName) {
+	char buf[BUF_SIZE] = { 0 };
+	strcat(buf, "Error in: ");
+	strcat(buf, funcName);
+	printCustomError(buf);
 }
@@ -0,0 +1,149 @@
+#include "hash.h"
+#include "common.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#define READ_SIZE (65536)
+
+// the first 32 bits of the fractional parts of the cube roots of the first 64 primes
+static const uint32_t roundConstants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t rotateRight(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+// process one 64 byte block
+static void sha256Block(struct Sha256 *ctx, const unsigned char *block) {
+	uint32_t w[64];
+	int i;
+	// the message schedule (the block is read as big-endian words)
+	for (i = 0; i < 16; i++) {
+		w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+		       (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+	}
+	for (i = 16; i < 64; i++) {
+		uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+	uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+	for (i = 0; i < 64; i++) {
+		uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + roundConstants[i] + w[i];
+		uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+	ctx->state[4] += e;
+	ctx->state[5] += f;
+	ctx->state[6] += g;
+	ctx->state[7] += h;
+}
+
+void sha256Init(struct Sha256 *ctx) {
+	// the first 32 bits of the fractional parts of the square roots of the first 8 primes
+	static const uint32_t initialState[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(ctx->state, initialState, sizeof(initialState));
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+void sha256Update(struct Sha256 *ctx, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	ctx->length += len;
+	// complete a partially filled block first
+	if (ctx->used > 0) {
+		size_t missing = sizeof(ctx->block) - ctx->used;
+		size_t count = len < missing ? len : missing;
+		memcpy(ctx->block + ctx->used, bytes, count);
+		ctx->used += count;
+		bytes += count;
+		len -= count;
+		if (ctx->used < sizeof(ctx->block)) { return; }
+		sha256Block(ctx, ctx->block);
+		ctx->used = 0;
+	}
+	// hash full blocks straight from the caller's buffer
+	while (len >= sizeof(ctx->block)) {
+		sha256Block(ctx, bytes);
+		bytes += sizeof(ctx->block);
+		len -= sizeof(ctx->block);
+	}
+	memcpy(ctx->block, bytes, len);
+	ctx->used = len;
+}
+
+void sha256Final(struct Sha256 *ctx, unsigned char digest[SHA256_SIZE]) {
+	uint64_t bits = ctx->length * 8;
+	// pad with a single 1 bit, zeros, and the message length (in bits, big-endian)
+	unsigned char padding[sizeof(ctx->block) * 2] = { 0x80 };
+	size_t padLen = (ctx->used < 56 ? 56 : 120) - ctx->used;
+	unsigned char lengthBytes[8];
+	int i;
+	for (i = 0; i < 8; i++) {
+		lengthBytes[i] = bits >> (56 - i * 8);
+	}
+	sha256Update(ctx, padding, padLen);
+	sha256Update(ctx, lengthBytes, sizeof(lengthBytes));
+
+	for (i = 0; i < 8; i++) {
+		digest[i * 4] = ctx->state[i] >> 24;
+		digest[i * 4 + 1] = ctx->state[i] >> 16;
+		digest[i * 4 + 2] = ctx->state[i] >> 8;
+		digest[i * 4 + 3] = ctx->state[i];
+	}
+}
+
+int sha256File(struct Sha256 *ctx, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == ERROR) { return ERROR; }
+	unsigned char buf[READ_SIZE];
+	ssize_t bytes;
+	while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+		sha256Update(ctx, buf, bytes);
+	}
+	close(fd);
+	return bytes == ERROR ? ERROR : SUCCESS;
+}
+
+void sha256String(struct Sha256 *ctx, const char *str) {
+	sha256Update(ctx, str, strlen(str) + 1);
+}
+
+void hashToHex(const unsigned char digest[SHA256_SIZE], char hex[SHA256_HEX_SIZE]) {
+	static const char digits[] = "0123456789abcdef";
+	int i;
+	for (i = 0; i < SHA256_SIZE; i++) {
+		hex[i * 2] = digits[digest[i] >> 4];
+		hex[i * 2 + 1] = digits[digest[i] & 0xf];
+	}
+	hex[SHA256_SIZE * 2] = '\0';
+}
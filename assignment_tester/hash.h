@@ -0,0 +1,31 @@
+#ifndef __HASH__
+#define __HASH__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE     (32)
+// hex digits + null-terminator
+#define SHA256_HEX_SIZE (SHA256_SIZE * 2 + 1)
+
+struct Sha256 {
+	uint32_t state[8];
+	// total amount of bytes hashed so far
+	uint64_t length;
+	// bytes waiting for a full 64 byte block
+	unsigned char block[64];
+	size_t used;
+};
+
+void sha256Init(struct Sha256 *ctx);
+void sha256Update(struct Sha256 *ctx, const void *data, size_t len);
+void sha256Final(struct Sha256 *ctx, unsigned char digest[SHA256_SIZE]);
+
+// feed the whole content of a file (returns ERROR if it can't be read)
+int sha256File(struct Sha256 *ctx, const char *path);
+// feed a null-terminated string (including the terminator, so "ab","c" != "a","bc")
+void sha256String(struct Sha256 *ctx, const char *str);
+
+void hashToHex(const unsigned char digest[SHA256_SIZE], char hex[SHA256_HEX_SIZE]);
+
+#endif
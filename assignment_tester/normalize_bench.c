@@ -0,0 +1,133 @@
+// compares the throughput of the normalizers (the similarity mode's space removal and case folding)
+// usage: normalize_bench.out [MB] [rounds]
+// the input looks like the students' output - words and numbers, with the odd run of spaces
+// every normalizer the CPU supports is first checked against the scalar one
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "compare.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MB     (64)
+#define DEFAULT_ROUNDS (5)
+#define BYTES_PER_MB   (1024L * 1024L)
+// the lengths of the inputs the normalizers are checked on (around the vector sizes)
+#define CHECK_LENGTHS  (200)
+
+void printCustomError(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+}
+
+void printError(const char *funcName) {
+	perror(funcName);
+}
+
+static const char *names[NORMALIZERS] = {
+	[NORMALIZE_SCALAR] = "scalar",
+	[NORMALIZE_SSE2] = "sse2",
+	[NORMALIZE_AVX2] = "avx2",
+};
+
+static double getTimeUsec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void fillText(char *buf, size_t len) {
+	static const char *words[] = { "Sum", "of", "the", "numbers", "is", "RESULT:", "ok", "\t", "  " };
+	const int wordCount = sizeof(words) / sizeof(words[0]);
+	unsigned seed = 42;
+	size_t pos = 0;
+	while (pos < len) {
+		char word[32];
+		int r = rand_r(&seed) % (wordCount + 3);
+		if (r < wordCount) {
+			snprintf(word, sizeof(word), "%s", words[r]);
+		} else {
+			snprintf(word, sizeof(word), "%d", rand_r(&seed) % 100000);
+		}
+		// a space between the words, and now and then a line break
+		const char *sep = rand_r(&seed) % 8 ? " " : "\n";
+		size_t wordLen = strlen(word);
+		size_t i;
+		for (i = 0; i < wordLen && pos < len; i++) { buf[pos++] = word[i]; }
+		if (pos < len) { buf[pos++] = sep[0]; }
+	}
+}
+
+// every byte value, at every length and alignment around the vector sizes, and in place
+static int checkNormalizer(enum Normalizer which) {
+	char src[CHECK_LENGTHS + 64], expected[CHECK_LENGTHS + 64], actual[CHECK_LENGTHS + 64];
+	unsigned seed = 7;
+	int round, len, offset;
+	for (round = 0; round < 64; round++) {
+		int i;
+		for (i = 0; i < (int)sizeof(src); i++) {
+			// mostly the interesting bytes (spaces, letters and the ones next to them)
+			src[i] = round % 2 ? (char)(round * 64 + i) : " \t\n\v\f\r\x08\x0e\x1f!@`aAzZ{~\x80\xff"[rand_r(&seed) % 20];
+		}
+		for (len = 0; len < CHECK_LENGTHS; len++) {
+			for (offset = 0; offset < 4; offset++) {
+				size_t expectedLen = normalizeWith(NORMALIZE_SCALAR, src + offset, len, expected);
+				size_t actualLen = normalizeWith(which, src + offset, len, actual);
+				if (actualLen != expectedLen || memcmp(actual, expected, expectedLen) != 0) { return FALSE; }
+				char inPlace[CHECK_LENGTHS + 64];
+				memcpy(inPlace, src + offset, len);
+				actualLen = normalizeWith(which, inPlace, len, inPlace);
+				if (actualLen != expectedLen || memcmp(inPlace, expected, expectedLen) != 0) { return FALSE; }
+			}
+		}
+	}
+	return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+	long mb = argc > 1 ? atol(argv[1]) : DEFAULT_MB;
+	int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+	if (mb <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: %s [MB] [rounds]\n", argv[0]);
+		return 1;
+	}
+	size_t len = mb * BYTES_PER_MB;
+	char *src = malloc(len);
+	char *dest = malloc(len);
+	if (src == NULL || dest == NULL) {
+		printCustomError("Out of memory");
+		return 1;
+	}
+	fillText(src, len);
+
+	printf("%-8s %10s %10s\n", "", "MB/s", "speedup");
+	double scalarUsec = 0;
+	int status = 0;
+	int which;
+	for (which = NORMALIZE_SCALAR; which < NORMALIZERS; which++) {
+		if (!normalizerSupported(which)) {
+			printf("%-8s %10s\n", names[which], "-");
+			continue;
+		}
+		if (!checkNormalizer(which)) {
+			printf("%-8s %10s\n", names[which], "WRONG");
+			status = 1;
+			continue;
+		}
+		// the best round, so a stray interruption doesn't count
+		double best = 0;
+		int round;
+		for (round = 0; round < rounds; round++) {
+			double start = getTimeUsec();
+			normalizeWith(which, src, len, dest);
+			double usec = getTimeUsec() - start;
+			if (round == 0 || usec < best) { best = usec; }
+		}
+		if (which == NORMALIZE_SCALAR) { scalarUsec = best; }
+		printf("%-8s %10.0f %9.2fx\n", names[which], mb / (best / 1e6), scalarUsec / best);
+	}
+	free(src);
+	free(dest);
+	return status;
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+
+#include "profile.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define USEC_PER_MSEC (1000.0)
+
+static const char *const phaseNames[PHASE_COUNT] = {
+	"find", "compile", "run", "compare", "cleanup"
+};
+
+const char *phaseName(int phase) {
+	return phase >= 0 && phase < PHASE_COUNT ? phaseNames[phase] : "unknown";
+}
+
+long long profileNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+long long profileLap(long long *mark) {
+	long long now = profileNow();
+	long long elapsed = now - *mark;
+	*mark = now;
+	return elapsed;
+}
+
+static int compareValues(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+// slowest first
+static int compareStudents(const void *a, const void *b, void *arg) {
+	const struct PhaseTimes *times = ((const void **)arg)[0];
+	int phase = *(const int *)((const void **)arg)[1];
+	long long x = times[*(const int *)a].usec[phase], y = times[*(const int *)b].usec[phase];
+	return (x < y) - (x > y);
+}
+
+// nearest-rank percentile of sorted values
+static long long percentile(const long long *sorted, int count, int percent) {
+	int rank = (count * percent + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void profileReport(FILE *out, char *const names[], const struct PhaseTimes times[], int count,
+                   int slowest, long long scanUsec) {
+	fprintf(out, "graded %d students (scanning the directory took %.3f ms)\n", count, scanUsec / USEC_PER_MSEC);
+	if (count == 0) { return; }
+	long long *values = malloc(count * sizeof(long long));
+	int *order = malloc(count * sizeof(int));
+	if (values == NULL || order == NULL) {
+		printCustomError("Out of memory");
+		free(values);
+		free(order);
+		return;
+	}
+
+	fprintf(out, "%-8s %12s %10s %10s %10s %10s\n", "phase", "total ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+	int phase, i;
+	for (phase = 0; phase < PHASE_COUNT; phase++) {
+		long long total = 0;
+		for (i = 0; i < count; i++) {
+			values[i] = times[i].usec[phase];
+			total += values[i];
+		}
+		qsort(values, count, sizeof(long long), compareValues);
+		fprintf(out, "%-8s %12.3f %10.3f %10.3f %10.3f %10.3f\n", phaseName(phase),
+		        total / USEC_PER_MSEC,
+		        percentile(values, count, 50) / USEC_PER_MSEC,
+		        percentile(values, count, 90) / USEC_PER_MSEC,
+		        percentile(values, count, 99) / USEC_PER_MSEC,
+		        values[count - 1] / USEC_PER_MSEC);
+	}
+
+	if (slowest > count) { slowest = count; }
+	for (phase = 0; phase < PHASE_COUNT; phase++) {
+		for (i = 0; i < count; i++) {
+			order[i] = i;
+		}
+		const void *context[2] = { times, &phase };
+		qsort_r(order, count, sizeof(int), compareStudents, context);
+		fprintf(out, "slowest %s:", phaseName(phase));
+		for (i = 0; i < slowest; i++) {
+			fprintf(out, " %s (%.3f ms)", names[order[i]], times[order[i]].usec[phase] / USEC_PER_MSEC);
+		}
+		fprintf(out, "\n");
+	}
+	free(values);
+	free(order);
+}
+
+// write a JSON string (with the quotes)
+static void writeJsonString(FILE *out, const char *str) {
+	fputc('"', out);
+	for (; *str != '\0'; str++) {
+		unsigned char ch = *str;
+		if (ch == '"' || ch == '\\') {
+			fprintf(out, "\\%c", ch);
+		} else if (ch < 0x20) {
+			fprintf(out, "\\u%04x", ch);
+		} else {
+			fputc(ch, out);
+		}
+	}
+	fputc('"', out);
+}
+
+int profileLogLine(FILE *out, const char *name, int grade, const char *reason, const struct PhaseTimes *times) {
+	fprintf(out, "{\"student\":");
+	writeJsonString(out, name);
+	fprintf(out, ",\"grade\":%d,\"reason\":", grade);
+	writeJsonString(out, reason);
+	long long total = 0;
+	int phase;
+	for (phase = 0; phase < PHASE_COUNT; phase++) {
+		fprintf(out, ",\"%s_ms\":%.3f", phaseName(phase), times->usec[phase] / USEC_PER_MSEC);
+		total += times->usec[phase];
+	}
+	fprintf(out, ",\"total_ms\":%.3f}\n", total / USEC_PER_MSEC);
+	return ferror(out) ? ERROR : SUCCESS;
+}
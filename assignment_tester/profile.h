@@ -0,0 +1,34 @@
+#ifndef __PROFILE__
+#define __PROFILE__
+
+#include <stdio.h>
+
+// the phases of grading a student
+enum Phase {
+	PHASE_FIND    = 0,
+	PHASE_COMPILE = 1,
+	PHASE_RUN     = 2,
+	PHASE_COMPARE = 3,
+	PHASE_CLEANUP = 4,
+	PHASE_COUNT   = 5,
+};
+
+// how long every phase of a student took (in microseconds, CLOCK_MONOTONIC)
+struct PhaseTimes {
+	long long usec[PHASE_COUNT];
+};
+
+const char *phaseName(int phase);
+
+// current CLOCK_MONOTONIC time in microseconds
+long long profileNow(void);
+// the time since '*mark' (and move the mark to now)
+long long profileLap(long long *mark);
+
+// print the totals, the percentiles and the slowest students of every phase
+void profileReport(FILE *out, char *const names[], const struct PhaseTimes times[], int count,
+                   int slowest, long long scanUsec);
+// write a JSON line with a student's phases (and result)
+int profileLogLine(FILE *out, const char *name, int grade, const char *reason, const struct PhaseTimes *times);
+
+#endif
@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+
+#include "remote.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define UNIX_PREFIX     "unix:"
+#define LISTEN_BACKLOG  (64)
+// the length and the type byte
+#define HEADER_SIZE     (5)
+
+void frameInit(struct RemoteFrame *frame, int type) {
+	frame->type = type;
+	frame->length = 0;
+	frame->offset = 0;
+}
+
+int framePutBytes(struct RemoteFrame *frame, const void *bytes, uint32_t size) {
+	if (size > REMOTE_MAX_FRAME - frame->length) { return ERROR; }
+	memcpy(frame->payload + frame->length, bytes, size);
+	frame->length += size;
+	return SUCCESS;
+}
+
+int framePut32(struct RemoteFrame *frame, uint32_t value) {
+	uint32_t wire = htonl(value);
+	return framePutBytes(frame, &wire, sizeof(wire));
+}
+
+int framePut64(struct RemoteFrame *frame, uint64_t value) {
+	if (framePut32(frame, value >> 32) == ERROR) { return ERROR; }
+	return framePut32(frame, value & 0xffffffffu);
+}
+
+int framePutString(struct RemoteFrame *frame, const char *str) {
+	uint32_t size = strlen(str);
+	if (framePut32(frame, size) == ERROR) { return ERROR; }
+	return framePutBytes(frame, str, size);
+}
+
+int frameGetBytes(struct RemoteFrame *frame, void *bytes, uint32_t size) {
+	if (size > frame->length - frame->offset) { return ERROR; }
+	memcpy(bytes, frame->payload + frame->offset, size);
+	frame->offset += size;
+	return SUCCESS;
+}
+
+int frameGet32(struct RemoteFrame *frame, uint32_t *value) {
+	uint32_t wire;
+	if (frameGetBytes(frame, &wire, sizeof(wire)) == ERROR) { return ERROR; }
+	*value = ntohl(wire);
+	return SUCCESS;
+}
+
+int frameGet64(struct RemoteFrame *frame, uint64_t *value) {
+	uint32_t high, low;
+	if (frameGet32(frame, &high) == ERROR || frameGet32(frame, &low) == ERROR) { return ERROR; }
+	*value = ((uint64_t)high << 32) | low;
+	return SUCCESS;
+}
+
+int frameGetString(struct RemoteFrame *frame, char *buf, uint32_t size) {
+	uint32_t length;
+	if (frameGet32(frame, &length) == ERROR || length >= size) { return ERROR; }
+	if (frameGetBytes(frame, buf, length) == ERROR) { return ERROR; }
+	buf[length] = '\0';
+	// a name with a NUL in it isn't a name
+	return memchr(buf, '\0', length) == NULL ? SUCCESS : ERROR;
+}
+
+static int writeAll(int fd, const void *buf, size_t size) {
+	const char *ptr = buf;
+	while (size > 0) {
+		ssize_t bytes = send(fd, ptr, size, MSG_NOSIGNAL);
+		if (bytes == ERROR) {
+			if (errno == EINTR) { continue; }
+			return ERROR;
+		}
+		ptr += bytes;
+		size -= bytes;
+	}
+	return SUCCESS;
+}
+
+static int readAll(int fd, void *buf, size_t size) {
+	char *ptr = buf;
+	while (size > 0) {
+		ssize_t bytes = recv(fd, ptr, size, 0);
+		if (bytes == ERROR && errno == EINTR) { continue; }
+		if (bytes <= 0) { return ERROR; }
+		ptr += bytes;
+		size -= bytes;
+	}
+	return SUCCESS;
+}
+
+int remoteSend(int fd, const struct RemoteFrame *frame) {
+	// one send per frame, so frames from different threads never interleave mid-header
+	unsigned char buf[HEADER_SIZE + REMOTE_MAX_FRAME];
+	uint32_t length = htonl(frame->length + 1);
+	memcpy(buf, &length, sizeof(length));
+	buf[sizeof(length)] = frame->type;
+	memcpy(buf + HEADER_SIZE, frame->payload, frame->length);
+	return writeAll(fd, buf, HEADER_SIZE + frame->length);
+}
+
+int remoteReceive(int fd, struct RemoteFrame *frame) {
+	unsigned char header[HEADER_SIZE];
+	if (readAll(fd, header, HEADER_SIZE) == ERROR) { return ERROR; }
+	uint32_t length;
+	memcpy(&length, header, sizeof(length));
+	length = ntohl(length);
+	if (length < 1 || length - 1 > REMOTE_MAX_FRAME) { return ERROR; }
+	frame->type = header[sizeof(length)];
+	frame->length = length - 1;
+	frame->offset = 0;
+	return readAll(fd, frame->payload, frame->length);
+}
+
+// split "<host>:<port>" (the host may be empty)
+static int splitAddress(const char *address, char *host, size_t hostSize, const char **port) {
+	const char *colon = strrchr(address, ':');
+	if (colon == NULL || colon[1] == '\0' || (size_t)(colon - address) >= hostSize) {
+		printCustomError("Invalid address (expected unix:<path> or <host>:<port>)");
+		return ERROR;
+	}
+	memcpy(host, address, colon - address);
+	host[colon - address] = '\0';
+	*port = colon + 1;
+	return SUCCESS;
+}
+
+static int unixAddress(const char *address, struct sockaddr_un *addr) {
+	const char *path = address + strlen(UNIX_PREFIX);
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		printCustomError("Socket path is too long");
+		return ERROR;
+	}
+	strcpy(addr->sun_path, path);
+	return SUCCESS;
+}
+
+static int isUnix(const char *address) {
+	return strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0;
+}
+
+// frames are small - don't let Nagle hold them back
+static void setNoDelay(int fd) {
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// connect or bind (and listen) to the first address 'address' resolves to
+static int openSocket(const char *address, int listening) {
+	if (isUnix(address)) {
+		struct sockaddr_un addr;
+		if (unixAddress(address, &addr) == ERROR) { return ERROR; }
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd == ERROR) {
+			printError("socket");
+			return ERROR;
+		}
+		if (listening) {
+			// a socket file left behind by a previous coordinator
+			unlink(addr.sun_path);
+			if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == ERROR ||
+			    listen(fd, LISTEN_BACKLOG) == ERROR) {
+				printError("bind");
+				close(fd);
+				return ERROR;
+			}
+		} else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == ERROR) {
+			close(fd);
+			return ERROR;
+		}
+		return fd;
+	}
+
+	char host[NI_MAXHOST];
+	const char *port;
+	if (splitAddress(address, host, sizeof(host), &port) == ERROR) { return ERROR; }
+	struct addrinfo hints, *list, *info;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	int ret = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list);
+	if (ret != SUCCESS) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(ret));
+		return ERROR;
+	}
+	int fd = ERROR;
+	for (info = list; info != NULL && fd == ERROR; info = info->ai_next) {
+		fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+		if (fd == ERROR) { continue; }
+		int one = 1;
+		if (listening) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			ret = bind(fd, info->ai_addr, info->ai_addrlen) == ERROR ? ERROR : listen(fd, LISTEN_BACKLOG);
+		} else {
+			ret = connect(fd, info->ai_addr, info->ai_addrlen);
+			setNoDelay(fd);
+		}
+		if (ret == ERROR) {
+			close(fd);
+			fd = ERROR;
+		}
+	}
+	freeaddrinfo(list);
+	if (fd == ERROR && listening) { printError("bind"); }
+	return fd;
+}
+
+int remoteListen(const char *address) {
+	return openSocket(address, TRUE);
+}
+
+int remoteConnect(const char *address) {
+	return openSocket(address, FALSE);
+}
+
+int remoteAccept(int fd_listen, int timeoutMs) {
+	int fd = accept4(fd_listen, NULL, NULL, SOCK_CLOEXEC);
+	if (fd == ERROR) { return ERROR; }
+	struct timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	// fails harmlessly for Unix sockets
+	setNoDelay(fd);
+	return fd;
+}
+
+void remoteUnlink(const char *address) {
+	struct sockaddr_un addr;
+	if (isUnix(address) && unixAddress(address, &addr) == SUCCESS) { unlink(addr.sun_path); }
+}
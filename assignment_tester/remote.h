@@ -0,0 +1,64 @@
+#ifndef __REMOTE__
+#define __REMOTE__
+
+#include "common.h"
+#include <stdint.h>
+
+// bumped whenever the frames change
+#define REMOTE_VERSION   (1)
+// the largest payload of a frame
+#define REMOTE_MAX_FRAME (4096)
+
+enum RemoteFrameType {
+	// worker -> coordinator: the protocol version and the digest of the worker's grading setup
+	REMOTE_HELLO     = 1,
+	// coordinator -> worker: grade a student (the job's id and the student's name)
+	REMOTE_JOB       = 2,
+	// worker -> coordinator: the job's id and the student's result
+	REMOTE_RESULT    = 3,
+	// worker -> coordinator: the worker is still alive
+	REMOTE_HEARTBEAT = 4,
+	// coordinator -> worker: there are no jobs left
+	REMOTE_DONE      = 5,
+	// coordinator -> worker: the worker's version or grading setup doesn't match ours
+	REMOTE_REJECT    = 6,
+};
+
+// on the wire, a frame is a 4-byte big endian length (of the type and the payload),
+// a type byte and the payload
+// the payload's integers are big endian too, and strings are prefixed by their 4-byte length
+struct RemoteFrame {
+	int type;
+	uint32_t length;
+	// the next byte frameGet* reads
+	uint32_t offset;
+	unsigned char payload[REMOTE_MAX_FRAME];
+};
+
+void frameInit(struct RemoteFrame *frame, int type);
+// append to the payload (ERROR if it doesn't fit)
+int framePut32(struct RemoteFrame *frame, uint32_t value);
+int framePut64(struct RemoteFrame *frame, uint64_t value);
+int framePutBytes(struct RemoteFrame *frame, const void *bytes, uint32_t size);
+int framePutString(struct RemoteFrame *frame, const char *str);
+// read the payload in the order it was written (ERROR if the frame is too short)
+int frameGet32(struct RemoteFrame *frame, uint32_t *value);
+int frameGet64(struct RemoteFrame *frame, uint64_t *value);
+int frameGetBytes(struct RemoteFrame *frame, void *bytes, uint32_t size);
+// the string is NUL-terminated (ERROR if it doesn't fit in 'size')
+int frameGetString(struct RemoteFrame *frame, char *buf, uint32_t size);
+
+// send or receive a whole frame
+// remoteReceive returns ERROR if the other side is gone, timed out or sent something invalid
+int remoteSend(int fd, const struct RemoteFrame *frame);
+int remoteReceive(int fd, struct RemoteFrame *frame);
+
+// 'address' is "unix:<path>" or "<host>:<port>" (an empty host listens on all interfaces)
+int remoteListen(const char *address);
+int remoteConnect(const char *address);
+// accept a connection - its reads and writes fail once they block for longer than 'timeoutMs'
+int remoteAccept(int fd_listen, int timeoutMs);
+// remove a Unix socket's file (nothing to do for TCP)
+void remoteUnlink(const char *address);
+
+#endif
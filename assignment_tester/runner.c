@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+
+#include "runner.h"
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// a job carries the binary, the program's stdout and its stderr
+#define JOB_FDS (3)
+
+// a program started by a runner
+struct RunnerChild {
+	int id;
+	pid_t pid;
+	// ERROR if the kernel doesn't support pidfds (the runner checks every millisecond instead)
+	int pidfd;
+};
+
+// what a runner process works with
+struct RunnerState {
+	int fd;
+	const struct SpawnAttr *attr;
+	// kept open for the whole run - a program gets a private copy (its own offset)
+	int *inputs;
+	const char **inputPaths;
+	int inputCount;
+	struct RunnerChild *children;
+	int childCount;
+	int childCapacity;
+};
+
+// send a message (with up to JOB_FDS descriptors)
+static int sendMessage(int fd, const struct RunnerMessage *msg, const int *fds, int fdCount) {
+	struct iovec iov = { (void *)msg, sizeof(*msg) };
+	struct msghdr hdr = { 0 };
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	char control[CMSG_SPACE(JOB_FDS * sizeof(int))];
+	if (fdCount > 0) {
+		memset(control, 0, sizeof(control));
+		hdr.msg_control = control;
+		hdr.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fds, fdCount * sizeof(int));
+	}
+	ssize_t bytes;
+	do {
+		bytes = sendmsg(fd, &hdr, MSG_NOSIGNAL);
+	} while (bytes == ERROR && errno == EINTR);
+	return bytes == sizeof(*msg) ? SUCCESS : ERROR;
+}
+
+// receive a message and the descriptors attached to it
+// returns the amount of descriptors, 0 if the other side is gone or ERROR
+static int receiveMessage(int fd, struct RunnerMessage *msg, int *fds, int maxFds, int *fdCount) {
+	struct iovec iov = { msg, sizeof(*msg) };
+	struct msghdr hdr = { 0 };
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	char control[CMSG_SPACE(JOB_FDS * sizeof(int))];
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof(control);
+	ssize_t bytes;
+	do {
+		bytes = recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC);
+	} while (bytes == ERROR && errno == EINTR);
+	if (bytes <= 0) { return bytes; }
+
+	*fdCount = 0;
+	struct cmsghdr *cmsg;
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) { continue; }
+		int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int received[JOB_FDS];
+		memcpy(received, CMSG_DATA(cmsg), count * sizeof(int));
+		int i;
+		for (i = 0; i < count; i++) {
+			// never keep descriptors we didn't ask for
+			if (*fdCount < maxFds) {
+				fds[(*fdCount)++] = received[i];
+			} else {
+				close(received[i]);
+			}
+		}
+	}
+	return bytes == sizeof(*msg) ? (int)bytes : ERROR;
+}
+
+// open a private copy of an input (so concurrent programs don't share the offset)
+static int openInput(struct RunnerState *state, int input) {
+	if (input < 0 || input >= state->inputCount) {
+		errno = EINVAL;
+		return ERROR;
+	}
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", state->inputs[input]);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	// no /proc - open it by its path
+	if (fd == ERROR) { fd = open(state->inputPaths[input], O_RDONLY | O_CLOEXEC); }
+	return fd;
+}
+
+static void startChild(struct RunnerState *state, struct RunnerMessage *msg, int *fds, int fdCount) {
+	struct RunnerMessage reply = { 0 };
+	reply.type = RUNNER_STARTED;
+	reply.id = msg->id;
+	reply.pid = ERROR;
+
+	int fd_input = fdCount == JOB_FDS ? openInput(state, msg->input) : ERROR;
+	if (fdCount == JOB_FDS && fd_input != ERROR && state->childCount == state->childCapacity) {
+		int capacity = state->childCapacity ? state->childCapacity * 2 : 16;
+		struct RunnerChild *children = realloc(state->children, capacity * sizeof(struct RunnerChild));
+		if (children != NULL) {
+			state->children = children;
+			state->childCapacity = capacity;
+		}
+	}
+
+	if (fdCount != JOB_FDS) {
+		reply.error = EINVAL;
+	} else if (fd_input == ERROR) {
+		reply.error = errno;
+	} else if (state->childCount == state->childCapacity) {
+		reply.error = ENOMEM;
+	} else {
+		struct SpawnAttr attr = *state->attr;
+		attr.execFd = fds[0];
+		spawnRedirect(&attr, fd_input, STDIN_FILENO);
+		spawnRedirect(&attr, fds[1], STDOUT_FILENO);
+		spawnRedirect(&attr, fds[2], STDERR_FILENO);
+		char *argv[] = { "a.out", NULL };
+		reply.pid = spawnProcess(&attr, NULL, argv);
+		reply.error = reply.pid == ERROR ? errno : 0;
+	}
+	if (fd_input != ERROR) { close(fd_input); }
+	int i;
+	for (i = 0; i < fdCount; i++) {
+		close(fds[i]);
+	}
+
+	if (reply.pid != ERROR) {
+		struct RunnerChild *child = &state->children[state->childCount++];
+		child->id = msg->id;
+		child->pid = reply.pid;
+		child->pidfd = syscall(SYS_pidfd_open, reply.pid, 0);
+	}
+	sendMessage(state->fd, &reply, NULL, 0);
+}
+
+static void killChild(struct RunnerState *state, int id) {
+	int i;
+	for (i = 0; i < state->childCount; i++) {
+		if (state->children[i].id == id) {
+			kill(-state->children[i].pid, SIGKILL);
+			return;
+		}
+	}
+}
+
+// reap a child that exited and report it
+static void reapChild(struct RunnerState *state, int index) {
+	struct RunnerChild *child = &state->children[index];
+	struct RunnerMessage reply = { 0 };
+	reply.type = RUNNER_EXITED;
+	reply.id = child->id;
+	reply.pid = child->pid;
+	// kill whatever the program left behind (while its pid can't be reused yet)
+	kill(-child->pid, SIGKILL);
+	if (wait4(child->pid, &reply.status, 0, &reply.usage) == ERROR) {
+		reply.error = errno;
+	}
+	if (child->pidfd != ERROR) { close(child->pidfd); }
+	state->children[index] = state->children[--state->childCount];
+	sendMessage(state->fd, &reply, NULL, 0);
+}
+
+static int hasChildExited(pid_t pid) {
+	siginfo_t info;
+	info.si_pid = 0;
+	return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == SUCCESS && info.si_pid == pid;
+}
+
+// the runner's main loop - serve the grader until it closes its end
+static void runnerMain(struct RunnerState *state) {
+	struct pollfd *pfds = NULL;
+	int pfdCapacity = 0;
+	while (TRUE) {
+		if (pfdCapacity < state->childCount + 1) {
+			pfdCapacity = state->childCapacity + 1;
+			struct pollfd *grown = realloc(pfds, pfdCapacity * sizeof(struct pollfd));
+			if (grown == NULL) { break; }
+			pfds = grown;
+		}
+		int timeoutMs = -1;
+		pfds[0].fd = state->fd;
+		pfds[0].events = POLLIN;
+		int i;
+		for (i = 0; i < state->childCount; i++) {
+			pfds[i + 1].fd = state->children[i].pidfd;
+			pfds[i + 1].events = POLLIN;
+			pfds[i + 1].revents = 0;
+			// no pidfd support (old kernel) - check on the child every millisecond
+			if (state->children[i].pidfd == ERROR) { timeoutMs = 1; }
+		}
+		int count = state->childCount;
+		if (poll(pfds, count + 1, timeoutMs) == ERROR && errno != EINTR) { break; }
+
+		// reap first (backwards, reaping moves the last child into the free slot)
+		for (i = count - 1; i >= 0; i--) {
+			struct RunnerChild *child = &state->children[i];
+			if ((child->pidfd != ERROR && pfds[i + 1].revents != 0) ||
+			    (child->pidfd == ERROR && hasChildExited(child->pid))) {
+				reapChild(state, i);
+			}
+		}
+
+		if (pfds[0].revents != 0) {
+			struct RunnerMessage msg;
+			int fds[JOB_FDS];
+			int fdCount = 0;
+			int ret = receiveMessage(state->fd, &msg, fds, JOB_FDS, &fdCount);
+			// the grader is gone
+			if (ret == 0 || (ret == ERROR && errno != EAGAIN)) { break; }
+			if (ret == ERROR) { continue; }
+			if (msg.type == RUNNER_START) {
+				startChild(state, &msg, fds, fdCount);
+			} else {
+				for (i = 0; i < fdCount; i++) { close(fds[i]); }
+				if (msg.type == RUNNER_KILL) { killChild(state, msg.id); }
+			}
+		}
+	}
+
+	// don't leave anything behind
+	while (state->childCount > 0) {
+		kill(-state->children[0].pid, SIGKILL);
+		reapChild(state, 0);
+	}
+	free(pfds);
+}
+
+int runnerPoolInit(struct RunnerPool *pool, int size, const struct SpawnAttr *attr,
+                   const char *inputPaths[], int inputCount) {
+	pool->enabled = FALSE;
+	pool->size = 0;
+	pool->runners = calloc(size, sizeof(struct Runner));
+	if (pool->runners == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+	if (pthread_mutex_init(&pool->lock, NULL) != SUCCESS) {
+		printError("pthread_mutex_init");
+		free(pool->runners);
+		return ERROR;
+	}
+
+	// the inputs are opened once, before forking, so every runner has them
+	int *inputs = malloc(inputCount * sizeof(int));
+	if (inputs == NULL) {
+		printCustomError("Out of memory");
+		runnerPoolDestroy(pool);
+		return ERROR;
+	}
+	int opened;
+	for (opened = 0; opened < inputCount; opened++) {
+		inputs[opened] = open(inputPaths[opened], O_RDONLY | O_CLOEXEC);
+		if (inputs[opened] == ERROR) {
+			printError("open");
+			break;
+		}
+	}
+
+	int status = opened == inputCount ? SUCCESS : ERROR;
+	while (status == SUCCESS && pool->size < size) {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == ERROR) {
+			printError("socketpair");
+			status = ERROR;
+			break;
+		}
+		pid_t pid = fork();
+		if (pid == ERROR) {
+			printError("fork");
+			close(fds[0]);
+			close(fds[1]);
+			status = ERROR;
+		} else if (pid == 0) {
+			// the runner - it only needs its own end of the socket (and the inputs)
+			int i;
+			for (i = 0; i < pool->size; i++) {
+				close(pool->runners[i].fd);
+			}
+			close(fds[0]);
+			struct RunnerState state = { fds[1], attr, inputs, inputPaths, inputCount, NULL, 0, 0 };
+			runnerMain(&state);
+			_exit(SUCCESS);
+		} else {
+			close(fds[1]);
+			pool->runners[pool->size].pid = pid;
+			pool->runners[pool->size].fd = fds[0];
+			pool->runners[pool->size].busy = FALSE;
+			pool->size++;
+		}
+	}
+
+	int i;
+	for (i = 0; i < opened; i++) {
+		close(inputs[i]);
+	}
+	free(inputs);
+	if (status == ERROR) {
+		runnerPoolDestroy(pool);
+		return ERROR;
+	}
+	pool->enabled = TRUE;
+	return SUCCESS;
+}
+
+void runnerPoolDestroy(struct RunnerPool *pool) {
+	int i;
+	// closing our end makes the runner kill its programs and exit
+	for (i = 0; i < pool->size; i++) {
+		close(pool->runners[i].fd);
+	}
+	for (i = 0; i < pool->size; i++) {
+		waitpid(pool->runners[i].pid, NULL, 0);
+	}
+	free(pool->runners);
+	pool->runners = NULL;
+	pool->size = 0;
+	pthread_mutex_destroy(&pool->lock);
+	pool->enabled = FALSE;
+}
+
+struct Runner *runnerAcquire(struct RunnerPool *pool) {
+	struct Runner *runner = NULL;
+	pthread_mutex_lock(&pool->lock);
+	int i;
+	for (i = 0; runner == NULL && i < pool->size; i++) {
+		if (!pool->runners[i].busy) {
+			runner = &pool->runners[i];
+			runner->busy = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return runner;
+}
+
+void runnerRelease(struct RunnerPool *pool, struct Runner *runner) {
+	pthread_mutex_lock(&pool->lock);
+	runner->busy = FALSE;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int runnerStart(struct Runner *runner, int id, int fd_bin, int input, int fd_output, int fd_error) {
+	struct RunnerMessage msg = { 0 };
+	msg.type = RUNNER_START;
+	msg.id = id;
+	msg.input = input;
+	int fds[JOB_FDS] = { fd_bin, fd_output, fd_error };
+	return sendMessage(runner->fd, &msg, fds, JOB_FDS);
+}
+
+int runnerKill(struct Runner *runner, int id) {
+	struct RunnerMessage msg = { 0 };
+	msg.type = RUNNER_KILL;
+	msg.id = id;
+	return sendMessage(runner->fd, &msg, NULL, 0);
+}
+
+int runnerReceive(struct Runner *runner, struct RunnerMessage *msg) {
+	int fds[JOB_FDS];
+	int fdCount = 0;
+	int ret = receiveMessage(runner->fd, msg, fds, 0, &fdCount);
+	if (ret == 0) {
+		// the runner died
+		errno = EPIPE;
+		return ERROR;
+	}
+	return ret == ERROR ? ERROR : SUCCESS;
+}
@@ -0,0 +1,71 @@
+#ifndef __RUNNER__
+#define __RUNNER__
+
+#include "common.h"
+#include "spawn.h"
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <pthread.h>
+
+enum RunnerMessageType {
+	// grader -> runner: start a program (the binary, its stdout and stderr are attached with SCM_RIGHTS)
+	RUNNER_START   = 1,
+	// grader -> runner: kill a program's process group
+	RUNNER_KILL    = 2,
+	// runner -> grader: the program started (or failed to)
+	RUNNER_STARTED = 3,
+	// runner -> grader: the program exited and was reaped
+	RUNNER_EXITED  = 4,
+};
+
+// a request from the grader or a reply from a runner
+struct RunnerMessage {
+	int type;
+	// the run it's about (chosen by the grader)
+	int id;
+	// RUNNER_START: the index of the input that becomes the program's stdin
+	int input;
+	// RUNNER_STARTED: the program's pid - or ERROR, with the reason in 'error'
+	pid_t pid;
+	int error;
+	// RUNNER_EXITED: wait4's results
+	int status;
+	struct rusage usage;
+};
+
+// a pre-forked process that starts the students' programs for one grading thread
+// it's forked before the grader grows, keeps the inputs open and reaps its own children
+struct Runner {
+	pid_t pid;
+	// our end of a SOCK_SEQPACKET socket pair
+	int fd;
+	// TRUE while a grading thread uses it
+	int busy;
+};
+
+struct RunnerPool {
+	// FALSE if the students' programs are started by the grader itself
+	int enabled;
+	struct Runner *runners;
+	int size;
+	pthread_mutex_t lock;
+};
+
+// fork 'size' runners
+// every program they start gets 'attr' (plus the redirections of its stdin, stdout and stderr)
+int runnerPoolInit(struct RunnerPool *pool, int size, const struct SpawnAttr *attr,
+                   const char *inputPaths[], int inputCount);
+// stop the runners (their programs are killed)
+void runnerPoolDestroy(struct RunnerPool *pool);
+
+// take a runner for the current thread (NULL if there are none left)
+struct Runner *runnerAcquire(struct RunnerPool *pool);
+void runnerRelease(struct RunnerPool *pool, struct Runner *runner);
+
+// ask the runner to start the binary in 'fd_bin' - the reply (RUNNER_STARTED) arrives through runnerReceive
+int runnerStart(struct Runner *runner, int id, int fd_bin, int input, int fd_output, int fd_error);
+int runnerKill(struct Runner *runner, int id);
+// wait for the next reply
+int runnerReceive(struct Runner *runner, struct RunnerMessage *msg);
+
+#endif
@@ -0,0 +1,481 @@
+#include "similarity.h"
+#include "compare.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the hash functions are a * x + b (the high 32 bits), with fixed random a's and b's
+static uint64_t mulSeeds[MINHASH_SIZE];
+static uint64_t addSeeds[MINHASH_SIZE];
+static int seeded = FALSE;
+
+static uint64_t splitMix64(uint64_t *state) {
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static void seedHashes(void) {
+	// fixed, so signatures are comparable between runs
+	uint64_t state = 0x5eed;
+	int i;
+	for (i = 0; i < MINHASH_SIZE; i++) {
+		mulSeeds[i] = splitMix64(&state) | 1;
+		addSeeds[i] = splitMix64(&state);
+	}
+	seeded = TRUE;
+}
+
+// FNV-1a, mixed so the low bits are as good as the high ones
+static uint64_t hashShingle(const char *shingle, int len) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	int i;
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)shingle[i];
+		hash *= 0x100000001b3ull;
+	}
+	return splitMix64(&hash);
+}
+
+void signatureBytes(struct Signature *sig, const char *norm, size_t len, int shingle) {
+	if (!seeded) { seedHashes(); }
+	int i;
+	for (i = 0; i < MINHASH_SIZE; i++) {
+		sig->mins[i] = UINT32_MAX;
+	}
+	sig->empty = len < (size_t)shingle;
+	if (sig->empty) { return; }
+
+	size_t pos;
+	for (pos = 0; pos + shingle <= len; pos++) {
+		uint64_t hash = hashShingle(norm + pos, shingle);
+		for (i = 0; i < MINHASH_SIZE; i++) {
+			uint32_t value = (mulSeeds[i] * hash + addSeeds[i]) >> 32;
+			if (value < sig->mins[i]) { sig->mins[i] = value; }
+		}
+	}
+}
+
+int signatureFile(struct Signature *sig, const char *path, int shingle) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == ERROR) {
+		printError("open");
+		return ERROR;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == ERROR) {
+		printError("fstat");
+		close(fd);
+		return ERROR;
+	}
+	char *buf = malloc(st.st_size + 1);
+	if (buf == NULL) {
+		printCustomError("Out of memory");
+		close(fd);
+		return ERROR;
+	}
+	size_t len = 0;
+	ssize_t bytes;
+	while (len < (size_t)st.st_size && (bytes = read(fd, buf + len, st.st_size - len)) > 0) {
+		len += bytes;
+	}
+	close(fd);
+	// normalized in place - it's never longer than the original
+	len = normalize(buf, len, buf);
+	signatureBytes(sig, buf, len, shingle);
+	free(buf);
+	return SUCCESS;
+}
+
+double signatureSimilarity(const struct Signature *first, const struct Signature *second) {
+	if (first->empty || second->empty) { return 0; }
+	int equal = 0;
+	int i;
+	for (i = 0; i < MINHASH_SIZE; i++) {
+		equal += first->mins[i] == second->mins[i];
+	}
+	return (double)equal / MINHASH_SIZE;
+}
+
+struct BandKey {
+	uint64_t key;
+	int index;
+};
+
+static int compareKeys(const void *a, const void *b) {
+	const struct BandKey *x = a, *y = b;
+	if (x->key != y->key) { return x->key < y->key ? -1 : 1; }
+	return x->index - y->index;
+}
+
+static int compareCandidates(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// most similar first
+static int comparePairs(const void *a, const void *b) {
+	const struct SimilarPair *x = a, *y = b;
+	if (x->similarity != y->similarity) { return x->similarity > y->similarity ? -1 : 1; }
+	if (x->first != y->first) { return x->first - y->first; }
+	return x->second - y->second;
+}
+
+// a pair is packed into one number (the smaller index first), so duplicates can be sorted away
+static int addCandidate(uint64_t **candidates, size_t *size, size_t *capacity, int first, int second) {
+	if (*size == *capacity) {
+		size_t grown = *capacity ? *capacity * 2 : 1024;
+		uint64_t *array = realloc(*candidates, grown * sizeof(uint64_t));
+		if (array == NULL) {
+			printCustomError("Out of memory");
+			return ERROR;
+		}
+		*candidates = array;
+		*capacity = grown;
+	}
+	(*candidates)[(*size)++] = ((uint64_t)first << 32) | (uint32_t)second;
+	return SUCCESS;
+}
+
+int findSimilarPairs(const struct Signature *sigs, int count, double threshold, struct SimilarPair **pairs) {
+	*pairs = NULL;
+	struct BandKey *keys = malloc((count + 1) * sizeof(struct BandKey));
+	if (keys == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+
+	uint64_t *candidates = NULL;
+	size_t size = 0, capacity = 0;
+	int status = SUCCESS;
+	int band, i, j;
+	for (band = 0; status == SUCCESS && band < LSH_BANDS; band++) {
+		// bucket the signatures by the hash of the band's rows
+		int keyCount = 0;
+		for (i = 0; i < count; i++) {
+			if (sigs[i].empty) { continue; }
+			uint64_t key = band;
+			int row;
+			for (row = 0; row < LSH_ROWS; row++) {
+				key = key * 0x100000001b3ull ^ sigs[i].mins[band * LSH_ROWS + row];
+				key = splitMix64(&key);
+			}
+			keys[keyCount].key = key;
+			keys[keyCount++].index = i;
+		}
+		qsort(keys, keyCount, sizeof(struct BandKey), compareKeys);
+
+		// every two signatures in a bucket are a candidate pair
+		int start;
+		for (start = 0; status == SUCCESS && start < keyCount; ) {
+			int end = start + 1;
+			while (end < keyCount && keys[end].key == keys[start].key) { end++; }
+			for (i = start; status == SUCCESS && i < end; i++) {
+				for (j = i + 1; status == SUCCESS && j < end; j++) {
+					status = addCandidate(&candidates, &size, &capacity, keys[i].index, keys[j].index);
+				}
+			}
+			start = end;
+		}
+	}
+	free(keys);
+	if (status == ERROR) {
+		free(candidates);
+		return ERROR;
+	}
+
+	// the same pair may share several bands
+	qsort(candidates, size, sizeof(uint64_t), compareCandidates);
+	struct SimilarPair *found = malloc((size + 1) * sizeof(struct SimilarPair));
+	if (found == NULL) {
+		printCustomError("Out of memory");
+		free(candidates);
+		return ERROR;
+	}
+	int foundCount = 0;
+	size_t k;
+	for (k = 0; k < size; k++) {
+		if (k > 0 && candidates[k] == candidates[k - 1]) { continue; }
+		int first = candidates[k] >> 32, second = candidates[k] & 0xffffffffu;
+		double similarity = signatureSimilarity(&sigs[first], &sigs[second]);
+		if (similarity < threshold) { continue; }
+		found[foundCount].first = first;
+		found[foundCount].second = second;
+		found[foundCount++].similarity = similarity;
+	}
+	free(candidates);
+	qsort(found, foundCount, sizeof(struct SimilarPair), comparePairs);
+	*pairs = found;
+	return foundCount;
+}
+
+// the text symbol's pattern bits in one block of 64 rows
+struct BlockMask {
+	size_t block;
+	uint64_t mask;
+};
+
+// vertical deltas (+1 / -1 bits) of a block's column and its bottom cell's value
+struct Block {
+	uint64_t plus;
+	uint64_t minus;
+	long score;
+};
+
+// advance a block a column, given the horizontal delta on top of it (-1, 0 or +1),
+// and return the one under it
+static int advanceBlock(struct Block *block, uint64_t eq, int hin) {
+	uint64_t plus = block->plus, minus = block->minus;
+	uint64_t hinNegative = hin < 0;
+	uint64_t xv = eq | minus;
+	eq |= hinNegative;
+	uint64_t xh = (((eq & plus) + plus) ^ plus) | eq;
+	uint64_t hPlus = minus | ~(xh | plus);
+	uint64_t hMinus = plus & xh;
+	int hout = (int)(hPlus >> 63) - (int)(hMinus >> 63);
+	hPlus = (hPlus << 1) | (hin > 0);
+	hMinus = (hMinus << 1) | hinNegative;
+	block->plus = hMinus | ~(xv | hPlus);
+	block->minus = hPlus & xv;
+	return hout;
+}
+
+long editDistance(const uint32_t *first, size_t firstLen, const uint32_t *second, size_t secondLen, size_t maxDistance) {
+	// the shorter one is the pattern (the column), the other one the text
+	if (firstLen > secondLen) {
+		const uint32_t *seq = first;
+		first = second;
+		second = seq;
+		size_t len = firstLen;
+		firstLen = secondLen;
+		secondLen = len;
+	}
+	const uint32_t *pattern = first, *text = second;
+	size_t n = firstLen, m = secondLen;
+	if (m - n > maxDistance) { return maxDistance + 1; }
+	if (n == 0) { return m; }
+
+	// for every symbol, the blocks it's in and its rows there (sorted by block)
+	uint32_t symbols = 0;
+	size_t i, j;
+	for (i = 0; i < n; i++) {
+		if (pattern[i] >= symbols) { symbols = pattern[i] + 1; }
+	}
+	size_t blocks = (n + 63) / 64;
+	size_t *starts = calloc(symbols + 1, sizeof(size_t));
+	size_t *ends = malloc((symbols + 1) * sizeof(size_t));
+	struct BlockMask *masks = malloc(n * sizeof(struct BlockMask));
+	struct Block *column = malloc(blocks * sizeof(struct Block));
+	if (starts == NULL || ends == NULL || masks == NULL || column == NULL) {
+		printCustomError("Out of memory");
+		free(starts);
+		free(ends);
+		free(masks);
+		free(column);
+		return ERROR;
+	}
+	// count the blocks of every symbol ('ends' holds the last one seen)
+	for (i = 0; i < symbols; i++) { ends[i] = SIZE_MAX; }
+	for (i = 0; i < n; i++) {
+		if (ends[pattern[i]] != i / 64) {
+			ends[pattern[i]] = i / 64;
+			starts[pattern[i] + 1]++;
+		}
+	}
+	for (i = 0; i < symbols; i++) { starts[i + 1] += starts[i]; }
+	// and fill them in ('ends' is where the next one goes)
+	memcpy(ends, starts, symbols * sizeof(size_t));
+	for (i = 0; i < n; i++) {
+		uint32_t symbol = pattern[i];
+		if (ends[symbol] == starts[symbol] || masks[ends[symbol] - 1].block != i / 64) {
+			masks[ends[symbol]].block = i / 64;
+			masks[ends[symbol]++].mask = 0;
+		}
+		masks[ends[symbol] - 1].mask |= 1ull << (i % 64);
+	}
+
+	// column 0 is D[i][0] = i - only the blocks the band reaches are started
+	// (rows further than 'maxDistance' from the diagonal are over it, so the blocks entirely above
+	// the band are left behind and the ones under it are started when it gets to them - with an
+	// overestimate of their previous column, which can't bring a cell in the band under its distance)
+	size_t top = 0, bottom = ((n < maxDistance ? n : maxDistance) + 63) / 64;
+	if (bottom > 0) { bottom--; }
+	size_t b;
+	for (b = 0; b <= bottom; b++) {
+		column[b].plus = ~0ull;
+		column[b].minus = 0;
+		column[b].score = 64 * (b + 1);
+	}
+	for (j = 0; j < m; j++) {
+		size_t col = j + 1;
+		size_t lastRow = col + maxDistance < n ? col + maxDistance : n;
+		for (; bottom < (lastRow - 1) / 64; bottom++) {
+			column[bottom + 1].plus = ~0ull;
+			column[bottom + 1].minus = 0;
+			column[bottom + 1].score = column[bottom].score + 64;
+		}
+		if (col > maxDistance && (col - maxDistance - 1) / 64 > top) {
+			top = (col - maxDistance - 1) / 64;
+		}
+
+		// the text symbol's blocks from 'top' on (a symbol the pattern lacks has none)
+		uint32_t symbol = text[j];
+		size_t mask = 0, maskEnd = 0;
+		if (symbol < symbols) {
+			mask = starts[symbol];
+			maskEnd = ends[symbol];
+			size_t high = maskEnd;
+			while (mask < high) {
+				size_t mid = mask + (high - mask) / 2;
+				if (masks[mid].block < top) {
+					mask = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+		}
+		// the row on top is D[0][j] = j, and a block left behind is taken to grow by one too
+		int hin = 1;
+		for (b = top; b <= bottom; b++) {
+			uint64_t eq = 0;
+			if (mask < maskEnd && masks[mask].block == b) { eq = masks[mask++].mask; }
+			hin = advanceBlock(&column[b], eq, hin);
+			column[b].score += hin;
+		}
+	}
+
+	// the last block's rows under the pattern don't count
+	uint64_t padding = n % 64 ? ~0ull << (n % 64) : 0;
+	long distance = column[blocks - 1].score - __builtin_popcountll(column[blocks - 1].plus & padding) +
+	                __builtin_popcountll(column[blocks - 1].minus & padding);
+	free(starts);
+	free(ends);
+	free(masks);
+	free(column);
+	return (size_t)distance > maxDistance ? (long)maxDistance + 1 : distance;
+}
+
+// the tokens of both outputs, as numbers (equal tokens get the same one)
+struct Tokens {
+	uint32_t *ids;
+	size_t count;
+};
+
+// an open addressing table of the distinct tokens
+struct TokenTable {
+	const char **tokens;
+	size_t *lens;
+	uint64_t *hashes;
+	uint32_t *ids;
+	size_t capacity;
+	uint32_t count;
+};
+
+static unsigned char foldChar(unsigned char ch) {
+	return ch >= 'a' && ch <= 'z' ? ch - ('a' - 'A') : ch;
+}
+
+static int isTokenSpace(unsigned char ch) {
+	return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+static int equalTokens(const char *first, const char *second, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (foldChar(first[i]) != foldChar(second[i])) { return FALSE; }
+	}
+	return TRUE;
+}
+
+static uint32_t internToken(struct TokenTable *table, const char *token, size_t len) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= foldChar(token[i]);
+		hash *= 0x100000001b3ull;
+	}
+	size_t slot = hash & (table->capacity - 1);
+	while (table->tokens[slot] != NULL) {
+		if (table->hashes[slot] == hash && table->lens[slot] == len && equalTokens(table->tokens[slot], token, len)) {
+			return table->ids[slot];
+		}
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	table->tokens[slot] = token;
+	table->lens[slot] = len;
+	table->hashes[slot] = hash;
+	table->ids[slot] = table->count;
+	return table->count++;
+}
+
+static size_t countTokens(const char *text, size_t len) {
+	size_t count = 0, i;
+	for (i = 0; i < len; i++) {
+		count += !isTokenSpace(text[i]) && (i == 0 || isTokenSpace(text[i - 1]));
+	}
+	return count;
+}
+
+static void splitTokens(struct TokenTable *table, const char *text, size_t len, struct Tokens *tokens) {
+	size_t i = 0;
+	tokens->count = 0;
+	while (i < len) {
+		while (i < len && isTokenSpace(text[i])) { i++; }
+		size_t start = i;
+		while (i < len && !isTokenSpace(text[i])) { i++; }
+		if (i > start) {
+			tokens->ids[tokens->count++] = internToken(table, text + start, i - start);
+		}
+	}
+}
+
+double tokenSimilarity(const char *first, size_t firstLen, const char *second, size_t secondLen, double minimum) {
+	struct Tokens tokens[2];
+	tokens[0].count = countTokens(first, firstLen);
+	tokens[1].count = countTokens(second, secondLen);
+	size_t longer = tokens[0].count > tokens[1].count ? tokens[0].count : tokens[1].count;
+	if (longer == 0) { return 1; }
+
+	struct TokenTable table;
+	table.capacity = 1;
+	// at most half full
+	while (table.capacity < 2 * (tokens[0].count + tokens[1].count)) { table.capacity *= 2; }
+	table.count = 0;
+	table.tokens = calloc(table.capacity, sizeof(const char *));
+	table.lens = malloc(table.capacity * sizeof(size_t));
+	table.hashes = malloc(table.capacity * sizeof(uint64_t));
+	table.ids = malloc(table.capacity * sizeof(uint32_t));
+	tokens[0].ids = malloc((tokens[0].count + 1) * sizeof(uint32_t));
+	tokens[1].ids = malloc((tokens[1].count + 1) * sizeof(uint32_t));
+	double ratio = ERROR;
+	if (table.tokens == NULL || table.lens == NULL || table.hashes == NULL || table.ids == NULL ||
+	    tokens[0].ids == NULL || tokens[1].ids == NULL) {
+		printCustomError("Out of memory");
+	} else {
+		splitTokens(&table, first, firstLen, &tokens[0]);
+		splitTokens(&table, second, secondLen, &tokens[1]);
+		// the most edits a ratio of 'minimum' allows
+		size_t maxDistance = minimum > 0 ? (size_t)((1 - minimum) * longer) : longer;
+		// a narrow band first, doubled until the distance fits in it - so the time depends on how
+		// different the outputs are rather than on how long they are
+		size_t band = SIMILARITY_BAND;
+		long distance;
+		while (TRUE) {
+			if (band > maxDistance) { band = maxDistance; }
+			distance = editDistance(tokens[0].ids, tokens[0].count, tokens[1].ids, tokens[1].count, band);
+			if (distance == ERROR || (size_t)distance <= band || band == maxDistance) { break; }
+			band *= 2;
+		}
+		if (distance != ERROR) { ratio = 1 - (double)distance / longer; }
+	}
+	free(table.tokens);
+	free(table.lens);
+	free(table.hashes);
+	free(table.ids);
+	free(tokens[0].ids);
+	free(tokens[1].ids);
+	return ratio;
+}
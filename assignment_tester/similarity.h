@@ -0,0 +1,61 @@
+#ifndef __SIMILARITY__
+#define __SIMILARITY__
+
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// the amount of hash functions in a MinHash signature
+#define MINHASH_SIZE    (128)
+// LSH splits the signature into bands of rows - two files become a candidate pair
+// if all of the rows of at least one band are equal
+// (32 bands of 4 rows find most pairs whose similarity is over ~0.5)
+#define LSH_BANDS       (32)
+#define LSH_ROWS        (MINHASH_SIZE / LSH_BANDS)
+
+// the first band tokenSimilarity tries (in edits) - it's doubled until the distance fits
+#define SIMILARITY_BAND (64)
+
+// default length of a shingle (in normalized characters)
+#define DEFAULT_SHINGLE (8)
+
+// the MinHash signature of a file's normalized (see 'normalize') k-shingles
+struct Signature {
+	uint32_t mins[MINHASH_SIZE];
+	// TRUE if the file is shorter than a shingle (it's similar to nothing)
+	int empty;
+};
+
+// a candidate pair and its estimated Jaccard similarity
+struct SimilarPair {
+	int first;
+	int second;
+	double similarity;
+};
+
+void signatureBytes(struct Signature *sig, const char *norm, size_t len, int shingle);
+// read and normalize a file, and sign it
+int signatureFile(struct Signature *sig, const char *path, int shingle);
+// the fraction of equal hashes - an estimate of the shingle sets' Jaccard similarity
+double signatureSimilarity(const struct Signature *first, const struct Signature *second);
+
+// find the pairs of signatures whose estimated similarity is at least 'threshold'
+// only the pairs LSH banding proposes are compared, so it's near-linear (unless many files are alike)
+// returns the amount of pairs (most similar first) in '*pairs' (free it), or ERROR
+int findSimilarPairs(const struct Signature *sigs, int count, double threshold, struct SimilarPair **pairs);
+
+// the Levenshtein distance of two sequences of symbols, bit-parallel (Myers/Hyyro: a column of
+// 64 cells per word operation) and only in the band of cells that can be within 'maxDistance'
+// of the diagonal, so it's O(len * maxDistance / 64)
+// returns 'maxDistance' + 1 if it's more than that, or ERROR
+long editDistance(const uint32_t *first, size_t firstLen, const uint32_t *second, size_t secondLen, size_t maxDistance);
+
+// how alike two outputs are, from 0 to 1: one minus the edit distance of their tokens over the
+// longer one's token count - so a typo costs a token, not the whole output
+// tokens are separated by whitespace and compared ignoring case (like the similarity mode,
+// except that word boundaries count)
+// the band only fits the ratios from 'minimum' up - a lower one is returned as some value under it
+// returns ERROR if out of memory
+double tokenSimilarity(const char *first, size_t firstLen, const char *second, size_t secondLen, double minimum);
+
+#endif
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+
+#include "spawn.h"
+#include "common.h"
+#include <sys/wait.h>
+#include <sched.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// the child runs on its own stack until it calls exec
+// (execvp needs some room to build the candidate paths)
+#define CHILD_STACK_SIZE (64 * 1024)
+
+struct SpawnArgs {
+	const struct SpawnAttr *attr;
+	const char *path;
+	char *const *argv;
+	// the signal mask to restore before exec
+	sigset_t *mask;
+	// set by the child if anything failed (the child shares our memory)
+	volatile int error;
+};
+
+void spawnInit(struct SpawnAttr *attr) {
+	attr->redirectCount = 0;
+	attr->limitCount = 0;
+	attr->newGroup = FALSE;
+	attr->searchPath = FALSE;
+	attr->execFd = ERROR;
+	attr->cpu = ERROR;
+}
+
+int spawnRedirect(struct SpawnAttr *attr, int from, int to) {
+	if (attr->redirectCount == SPAWN_MAX_REDIRECTS) { return ERROR; }
+	attr->redirects[attr->redirectCount].from = from;
+	attr->redirects[attr->redirectCount].to = to;
+	attr->redirectCount++;
+	return SUCCESS;
+}
+
+int spawnLimit(struct SpawnAttr *attr, int resource, rlim_t soft, rlim_t hard) {
+	if (attr->limitCount == SPAWN_MAX_LIMITS) { return ERROR; }
+	attr->limits[attr->limitCount].resource = resource;
+	attr->limits[attr->limitCount].limit.rlim_cur = soft;
+	attr->limits[attr->limitCount].limit.rlim_max = hard;
+	attr->limitCount++;
+	return SUCCESS;
+}
+
+// runs in the child, in our address space - so only plain system calls here
+static int spawnChild(void *arg) {
+	struct SpawnArgs *args = arg;
+	const struct SpawnAttr *attr = args->attr;
+
+	// signal handlers would run on our memory - reset them before we unblock signals
+	int sig;
+	for (sig = 1; sig < NSIG; sig++) {
+		struct sigaction action;
+		if (sigaction(sig, NULL, &action) == SUCCESS && action.sa_handler != SIG_IGN &&
+		    action.sa_handler != SIG_DFL) {
+			action.sa_handler = SIG_DFL;
+			sigaction(sig, &action, NULL);
+		}
+	}
+
+	if (attr->newGroup && setpgid(0, 0) == ERROR) { goto fail; }
+	if (attr->cpu != ERROR) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(attr->cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) == ERROR) { goto fail; }
+	}
+	int i;
+	for (i = 0; i < attr->limitCount; i++) {
+		if (setrlimit(attr->limits[i].resource, &attr->limits[i].limit) == ERROR) { goto fail; }
+	}
+	for (i = 0; i < attr->redirectCount; i++) {
+		int from = attr->redirects[i].from;
+		int to = attr->redirects[i].to;
+		// dup2 clears close-on-exec on the copy, but does nothing if the descriptors are equal
+		if (from == to ? fcntl(to, F_SETFD, 0) == ERROR : dup2(from, to) == ERROR) { goto fail; }
+	}
+	sigprocmask(SIG_SETMASK, args->mask, NULL);
+
+	if (attr->execFd != ERROR) {
+		fexecve(attr->execFd, args->argv, environ);
+	} else if (attr->searchPath) {
+		execvp(args->path, args->argv);
+	} else {
+		execv(args->path, args->argv);
+	}
+
+fail:
+	args->error = errno;
+	_exit(127);
+}
+
+pid_t spawnProcess(const struct SpawnAttr *attr, const char *path, char *const argv[]) {
+	char stack[CHILD_STACK_SIZE] __attribute__((aligned(16)));
+	sigset_t all, old;
+	struct SpawnArgs args = { attr, path, argv, &old, 0 };
+
+	// block signals until the child has reset the handlers
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	// CLONE_VFORK suspends us until the child calls exec (or exits)
+	// so the child can't outlive its stack, and we get its error right away
+	pid_t pid = clone(spawnChild, stack + sizeof(stack), CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+	int cloneErrno = errno;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (pid == ERROR) {
+		errno = cloneErrno;
+		return ERROR;
+	}
+	if (args.error != 0) {
+		// reap the failed child
+		waitpid(pid, NULL, 0);
+		errno = args.error;
+		return ERROR;
+	}
+	return pid;
+}
@@ -0,0 +1,43 @@
+#ifndef __SPAWN__
+#define __SPAWN__
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define SPAWN_MAX_REDIRECTS (4)
+#define SPAWN_MAX_LIMITS    (4)
+
+// what to set up in the child before it calls exec
+// (posix_spawn's file actions and attributes, plus resource limits)
+struct SpawnAttr {
+	// 'from' is dup2'ed to 'to' (in order, so a 'from' shouldn't be a previous 'to')
+	struct {
+		int from;
+		int to;
+	} redirects[SPAWN_MAX_REDIRECTS];
+	int redirectCount;
+	// setrlimit(resource, &limit)
+	struct {
+		int resource;
+		struct rlimit limit;
+	} limits[SPAWN_MAX_LIMITS];
+	int limitCount;
+	// TRUE to run the child in a new process group (whose id is the child's pid)
+	int newGroup;
+	// TRUE to look the program up in PATH (like execvp)
+	int searchPath;
+	// run the program from this descriptor instead of its path (like fexecve), or ERROR
+	int execFd;
+	// pin the child to this CPU (sched_setaffinity), or ERROR to let it run anywhere
+	int cpu;
+};
+
+void spawnInit(struct SpawnAttr *attr);
+int spawnRedirect(struct SpawnAttr *attr, int from, int to);
+int spawnLimit(struct SpawnAttr *attr, int resource, rlim_t soft, rlim_t hard);
+
+// start 'path' (or 'attr->execFd') without copying our address space (clone with CLONE_VM | CLONE_VFORK)
+// returns once the child called exec - or ERROR (with errno set) if the setup or the exec failed
+pid_t spawnProcess(const struct SpawnAttr *attr, const char *path, char *const argv[]);
+
+#endif
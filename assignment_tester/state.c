@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+
+#include "state.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static int compareEntries(const void *a, const void *b) {
+	return strcmp(((const struct StateEntry *)a)->name, ((const struct StateEntry *)b)->name);
+}
+
+// read the whole file into a null-terminated buffer
+static char *readContents(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == ERROR) {
+		printError("fstat");
+		return NULL;
+	}
+	char *contents = malloc(st.st_size + 1);
+	if (contents == NULL) {
+		printCustomError("Out of memory");
+		return NULL;
+	}
+	off_t size = 0;
+	ssize_t bytes;
+	while (size < st.st_size && (bytes = read(fd, contents + size, st.st_size - size)) > 0) {
+		size += bytes;
+	}
+	if (size < st.st_size) {
+		printError("read");
+		free(contents);
+		return NULL;
+	}
+	contents[size] = '\0';
+	return contents;
+}
+
+// split the contents into entries (in place)
+// lines that don't look like '<fingerprint>\t<name>\t<row>' are ignored
+static int parseEntries(struct GradingState *state) {
+	int capacity = 1;
+	char *ch;
+	for (ch = state->contents; *ch != '\0'; ch++) {
+		if (*ch == '\n') { capacity++; }
+	}
+	state->entries = malloc(capacity * sizeof(struct StateEntry));
+	if (state->entries == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+
+	char *line = state->contents;
+	while (*line != '\0') {
+		char *end = strchr(line, '\n');
+		if (end != NULL) { *end = '\0'; }
+		char *name = strchr(line, '\t');
+		char *row = name != NULL ? strchr(name + 1, '\t') : NULL;
+		if (row != NULL && name - line == SHA256_HEX_SIZE - 1) {
+			*name++ = '\0';
+			*row++ = '\0';
+			struct StateEntry *entry = &state->entries[state->size++];
+			entry->fingerprint = line;
+			entry->name = name;
+			entry->row = row;
+		}
+		if (end == NULL) { break; }
+		line = end + 1;
+	}
+
+	qsort(state->entries, state->size, sizeof(struct StateEntry), compareEntries);
+	return SUCCESS;
+}
+
+int stateLoad(struct GradingState *state, const char *path) {
+	state->enabled = FALSE;
+	state->contents = NULL;
+	state->entries = NULL;
+	state->size = 0;
+	state->fd_new = ERROR;
+	strcpy(state->path, path);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == ERROR) {
+		// the first run - everyone is graded
+		if (errno == ENOENT) {
+			state->enabled = TRUE;
+			return SUCCESS;
+		}
+		printError("open");
+		return ERROR;
+	}
+	state->contents = readContents(fd);
+	close(fd);
+	if (state->contents == NULL || parseEntries(state) == ERROR) {
+		free(state->contents);
+		state->contents = NULL;
+		return ERROR;
+	}
+	state->enabled = TRUE;
+	return SUCCESS;
+}
+
+void stateDestroy(struct GradingState *state) {
+	if (!state->enabled) { return; }
+	stateAbort(state);
+	free(state->entries);
+	free(state->contents);
+	state->entries = NULL;
+	state->contents = NULL;
+	state->size = 0;
+	state->enabled = FALSE;
+}
+
+const char *stateLookup(const struct GradingState *state, const char *name, const char *fingerprint) {
+	if (!state->enabled || state->size == 0) { return NULL; }
+	struct StateEntry key = { name, NULL, NULL };
+	const struct StateEntry *entry = bsearch(&key, state->entries, state->size,
+	                                         sizeof(struct StateEntry), compareEntries);
+	if (entry == NULL || strcmp(entry->fingerprint, fingerprint) != 0) { return NULL; }
+	return entry->row;
+}
+
+int stateBegin(struct GradingState *state) {
+	snprintf(state->tempPath, sizeof(state->tempPath), "%s.XXXXXX", state->path);
+	state->fd_new = mkostemp(state->tempPath, O_CLOEXEC);
+	if (state->fd_new == ERROR) {
+		printError("mkostemp");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+int stateWrite(struct GradingState *state, const char *name, const char *fingerprint, const char *row) {
+	// names with tabs or newlines can't be stored - they're simply graded again next time
+	if (strpbrk(name, "\t\n") != NULL) { return SUCCESS; }
+	if (dprintf(state->fd_new, "%s\t%s\t%s\n", fingerprint, name, row) < 0) {
+		printError("write");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+int stateCommit(struct GradingState *state) {
+	int status = SUCCESS;
+	// make sure the new state is on disk before it replaces the old one
+	if (fsync(state->fd_new) == ERROR) {
+		printError("fsync");
+		status = ERROR;
+	}
+	if (close(state->fd_new) == ERROR) {
+		printError("close");
+		status = ERROR;
+	}
+	state->fd_new = ERROR;
+	if (status == SUCCESS && rename(state->tempPath, state->path) == ERROR) {
+		printError("rename");
+		status = ERROR;
+	}
+	if (status == ERROR) { unlink(state->tempPath); }
+	return status;
+}
+
+void stateAbort(struct GradingState *state) {
+	if (state->fd_new == ERROR) { return; }
+	close(state->fd_new);
+	unlink(state->tempPath);
+	state->fd_new = ERROR;
+}
@@ -0,0 +1,54 @@
+#ifndef __STATE__
+#define __STATE__
+
+#include "common.h"
+#include "hash.h"
+
+// bump whenever the grading rules or the state file's format change
+// (every previous result is graded again)
+#define STATE_VERSION  (2)
+
+// state file path + ".XXXXXX"
+#define MAX_STATE_PATH (MAX_PATH + 8)
+
+// a student's result from a previous run
+struct StateEntry {
+	const char *name;
+	const char *fingerprint;
+	// the student's line in results.csv (without the newline)
+	const char *row;
+};
+
+// the results of the previous run, so unchanged students don't have to be graded again
+// every line of the file is '<fingerprint>\t<student>\t<results.csv line>'
+// the fingerprint covers everything a result depends on (see 'studentFingerprint')
+struct GradingState {
+	// FALSE if the grader runs without a state file
+	int enabled;
+	char path[MAX_PATH];
+	// the previous run's file (the entries point into it)
+	char *contents;
+	// sorted by name
+	struct StateEntry *entries;
+	int size;
+	// the new state file - written next to the old one and renamed over it
+	char tempPath[MAX_STATE_PATH];
+	int fd_new;
+};
+
+// load the state file (a missing file is an empty state)
+int stateLoad(struct GradingState *state, const char *path);
+// (does nothing if the state isn't loaded)
+void stateDestroy(struct GradingState *state);
+
+// the student's previous line in results.csv - or NULL if it was graded with a different fingerprint
+const char *stateLookup(const struct GradingState *state, const char *name, const char *fingerprint);
+
+// write a new state file, one student at a time (it replaces the old one in stateCommit)
+int stateBegin(struct GradingState *state);
+int stateWrite(struct GradingState *state, const char *name, const char *fingerprint, const char *row);
+int stateCommit(struct GradingState *state);
+// throw the new state file away instead (does nothing if there isn't one)
+void stateAbort(struct GradingState *state);
+
+#endif
@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+
+#include "watch.h"
+#include "profile.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// students appear, disappear and get renamed in the root
+#define ROOT_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+// anything that changes a submission's files
+#define DIR_EVENTS   (IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_ATTRIB | IN_ONLYDIR)
+#define EVENT_BUF    (64 * 1024)
+
+static struct WatchedDir *findDir(struct Watcher *watcher, const char *name) {
+	int i;
+	for (i = 0; i < watcher->size; i++) {
+		if (strcmp(watcher->dirs[i].name, name) == 0) { return &watcher->dirs[i]; }
+	}
+	return NULL;
+}
+
+static struct WatchedDir *findWd(struct Watcher *watcher, int wd) {
+	int i;
+	for (i = 0; i < watcher->size; i++) {
+		if (watcher->dirs[i].wd == wd) { return &watcher->dirs[i]; }
+	}
+	return NULL;
+}
+
+static void markDirty(struct WatchedDir *dir) {
+	dir->dirty = TRUE;
+	dir->lastChange = profileNow();
+}
+
+// start watching a directory in the root (or watch it again, if it was removed and came back)
+static struct WatchedDir *addDir(struct Watcher *watcher, const char *name) {
+	char path[MAX_PATH * 2];
+	snprintf(path, sizeof(path), "%s/%s", watcher->rootPath, name);
+	int wd = inotify_add_watch(watcher->fd, path, DIR_EVENTS);
+	// it's already gone (or not a directory) - there's nothing to grade
+	if (wd == ERROR) { return NULL; }
+
+	struct WatchedDir *dir = findDir(watcher, name);
+	if (dir == NULL) {
+		if (watcher->size == watcher->capacity) {
+			int capacity = watcher->capacity ? watcher->capacity * 2 : 64;
+			struct WatchedDir *dirs = realloc(watcher->dirs, capacity * sizeof(struct WatchedDir));
+			if (dirs == NULL) {
+				printCustomError("Out of memory");
+				inotify_rm_watch(watcher->fd, wd);
+				return NULL;
+			}
+			watcher->dirs = dirs;
+			watcher->capacity = capacity;
+		}
+		dir = &watcher->dirs[watcher->size];
+		dir->name = strdup(name);
+		if (dir->name == NULL) {
+			printCustomError("Out of memory");
+			inotify_rm_watch(watcher->fd, wd);
+			return NULL;
+		}
+		dir->dirty = FALSE;
+		dir->lastChange = 0;
+		watcher->size++;
+	}
+	dir->wd = wd;
+	dir->removed = FALSE;
+	return dir;
+}
+
+// watch every directory in the root (marking the new ones dirty, if requested)
+static int scanRoot(struct Watcher *watcher, int markNew) {
+	DIR *root = opendir(watcher->rootPath);
+	if (root == NULL) {
+		printError("opendir");
+		return ERROR;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(root))) {
+		if (entry->d_type != DT_DIR || !strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+			continue;
+		}
+		int known = findDir(watcher, entry->d_name) != NULL;
+		struct WatchedDir *dir = addDir(watcher, entry->d_name);
+		if (dir != NULL && markNew && !known) { markDirty(dir); }
+	}
+	closedir(root);
+	return SUCCESS;
+}
+
+int watcherInit(struct Watcher *watcher, const char *rootPath, int debounceMs) {
+	watcher->dirs = NULL;
+	watcher->size = 0;
+	watcher->capacity = 0;
+	watcher->debounceUsec = debounceMs * 1000LL;
+	strcpy(watcher->rootPath, rootPath);
+	watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->fd == ERROR) {
+		printError("inotify_init1");
+		return ERROR;
+	}
+	watcher->rootWd = inotify_add_watch(watcher->fd, rootPath, ROOT_EVENTS);
+	if (watcher->rootWd == ERROR) {
+		printError("inotify_add_watch");
+		close(watcher->fd);
+		return ERROR;
+	}
+	// watch the root first, so no student created in between is missed
+	if (scanRoot(watcher, FALSE) == ERROR) {
+		watcherDestroy(watcher);
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+void watcherDestroy(struct Watcher *watcher) {
+	int i;
+	for (i = 0; i < watcher->size; i++) {
+		free(watcher->dirs[i].name);
+	}
+	free(watcher->dirs);
+	watcher->dirs = NULL;
+	watcher->size = 0;
+	close(watcher->fd);
+}
+
+static void handleEvent(struct Watcher *watcher, const struct inotify_event *event) {
+	// the kernel dropped events - assume everything changed
+	if (event->mask & IN_Q_OVERFLOW) {
+		int i;
+		for (i = 0; i < watcher->size; i++) {
+			markDirty(&watcher->dirs[i]);
+		}
+		scanRoot(watcher, TRUE);
+		return;
+	}
+
+	if (event->wd == watcher->rootWd) {
+		if (!(event->mask & IN_ISDIR) || event->len == 0) { return; }
+		if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+			struct WatchedDir *dir = addDir(watcher, event->name);
+			if (dir != NULL) { markDirty(dir); }
+		} else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			struct WatchedDir *dir = findDir(watcher, event->name);
+			if (dir == NULL) { return; }
+			if (dir->wd != ERROR) { inotify_rm_watch(watcher->fd, dir->wd); }
+			dir->wd = ERROR;
+			dir->removed = TRUE;
+			markDirty(dir);
+		}
+		return;
+	}
+
+	struct WatchedDir *dir = findWd(watcher, event->wd);
+	if (dir == NULL) { return; }
+	if (event->mask & IN_IGNORED) {
+		// the watch is gone (the directory was removed or moved away)
+		dir->wd = ERROR;
+	} else {
+		markDirty(dir);
+	}
+}
+
+int watcherPoll(struct Watcher *watcher, int maxWaitMs) {
+	// wake up once the first dirty directory settles
+	long long now = profileNow();
+	long long timeoutMs = maxWaitMs;
+	int i;
+	for (i = 0; i < watcher->size; i++) {
+		if (!watcher->dirs[i].dirty) { continue; }
+		long long left = watcher->dirs[i].lastChange + watcher->debounceUsec - now;
+		long long leftMs = left > 0 ? (left + 999) / 1000 : 0;
+		if (leftMs < timeoutMs) { timeoutMs = leftMs; }
+	}
+
+	struct pollfd pfd = { watcher->fd, POLLIN, 0 };
+	int ret = poll(&pfd, 1, timeoutMs);
+	if (ret == ERROR) {
+		if (errno == EINTR) { return SUCCESS; }
+		printError("poll");
+		return ERROR;
+	}
+	if (ret == 0) { return SUCCESS; }
+
+	char buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t bytes;
+	while ((bytes = read(watcher->fd, buf, sizeof(buf))) > 0) {
+		char *ptr;
+		for (ptr = buf; ptr < buf + bytes; ) {
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+			handleEvent(watcher, event);
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	if (bytes == ERROR && errno != EAGAIN && errno != EINTR) {
+		printError("read");
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+int watcherCollect(struct Watcher *watcher, struct WatchChange **changes) {
+	long long now = profileNow();
+	int count = 0;
+	int i;
+	for (i = 0; i < watcher->size; i++) {
+		struct WatchedDir *dir = &watcher->dirs[i];
+		if (dir->dirty && now - dir->lastChange >= watcher->debounceUsec) { count++; }
+	}
+	*changes = NULL;
+	if (count == 0) { return 0; }
+	*changes = malloc(count * sizeof(struct WatchChange));
+	if (*changes == NULL) {
+		printCustomError("Out of memory");
+		return ERROR;
+	}
+
+	int taken = 0;
+	for (i = 0; i < watcher->size; ) {
+		struct WatchedDir *dir = &watcher->dirs[i];
+		if (!dir->dirty || now - dir->lastChange < watcher->debounceUsec) {
+			i++;
+			continue;
+		}
+		dir->dirty = FALSE;
+		struct WatchChange *change = &(*changes)[taken++];
+		change->removed = dir->removed;
+		if (dir->removed) {
+			// hand over the name and forget the directory
+			change->name = dir->name;
+			watcher->dirs[i] = watcher->dirs[--watcher->size];
+			continue;
+		}
+		change->name = strdup(dir->name);
+		if (change->name == NULL) {
+			printCustomError("Out of memory");
+			watcherFreeChanges(*changes, taken - 1);
+			*changes = NULL;
+			return ERROR;
+		}
+		i++;
+	}
+	return taken;
+}
+
+void watcherFreeChanges(struct WatchChange *changes, int count) {
+	int i;
+	for (i = 0; i < count; i++) {
+		free(changes[i].name);
+	}
+	free(changes);
+}
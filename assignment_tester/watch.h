@@ -0,0 +1,52 @@
+#ifndef __WATCH__
+#define __WATCH__
+
+#include "common.h"
+
+// a directory beneath the watched root (a student's directory)
+struct WatchedDir {
+	char *name;
+	// inotify watch descriptor (ERROR once the directory is gone)
+	int wd;
+	// TRUE if something changed since the directory was last collected
+	int dirty;
+	// TRUE if the directory was removed
+	int removed;
+	// the last change (CLOCK_MONOTONIC, in microseconds)
+	long long lastChange;
+};
+
+// a change whose debounce period passed
+struct WatchChange {
+	char *name;
+	// TRUE if the directory is gone
+	int removed;
+};
+
+// watches a root directory and the directories beneath it with inotify
+// a directory is reported once it didn't change for 'debounceUsec'
+// (so a submission that's still being copied is reported once it's complete)
+struct Watcher {
+	int fd;
+	char rootPath[MAX_PATH];
+	int rootWd;
+	long long debounceUsec;
+	struct WatchedDir *dirs;
+	int size;
+	int capacity;
+};
+
+// watch 'rootPath' and every directory in it
+int watcherInit(struct Watcher *watcher, const char *rootPath, int debounceMs);
+void watcherDestroy(struct Watcher *watcher);
+
+// wait for events - no longer than 'maxWaitMs', or the next debounce deadline
+// (EINTR is not an error, so a signal handler can make the caller stop)
+int watcherPoll(struct Watcher *watcher, int maxWaitMs);
+
+// take the directories whose changes settled
+// returns their amount and an array in '*changes' (free it with watcherFreeChanges)
+int watcherCollect(struct Watcher *watcher, struct WatchChange **changes);
+void watcherFreeChanges(struct WatchChange *changes, int count);
+
+#endif
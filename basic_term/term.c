@@ -1,6 +1,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <spawn.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -11,7 +12,6 @@
 #define SUCCESS       (0)
 
 #define NO_PID        (-1)
-#define CHILD_PROC    (0)
 #define CHILD_RUNNING (0)
 #define NOT_FOUND     (-1)
 
@@ -21,6 +21,8 @@
 #define MAX_ARGS      (100)
 #define MAX_CHILDREN  (100)
 
+extern char **environ;
+
 typedef enum { FALSE = 0, TRUE = 1 } bool_t;
 
 typedef struct {
@@ -311,18 +313,13 @@ int getCommandIndex(Command *cmd) {
 
 void runNonBuiltin(ProgramData *data) {
 	Command *cmd = &data->history[data->history_size - 1];
-	pid_t pid = fork();
-	if (pid == ERROR) {
-		handleError("fork failed");
-	// is child process
-	} else if (pid == CHILD_PROC) {
-		
-		// call the appropriate binary file with execvp
-		if (execvp(cmd->name, cmd->args) == ERROR) {
-			handleError("exec failed");
-			exit(ERROR);
-		}
-	// is parent process
+	pid_t pid;
+	// posix_spawnp doesn't copy our address space (unlike fork)
+	// and reports a failed exec to us directly
+	int ret = posix_spawnp(&pid, cmd->name, NULL, NULL, cmd->args, environ);
+	if (ret != SUCCESS) {
+		cmd->done = TRUE;
+		handleError("exec failed");
 	} else {
 		cmd->pid = pid;
 		// is foreground